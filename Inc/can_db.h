@@ -0,0 +1,96 @@
+#ifndef __CAN_DB_H
+#define __CAN_DB_H
+
+#include <stdint.h>
+#include "mcp2515.h"
+#include "mcp2515_filter.h"
+#include "obd_pid.h"
+#include "can_db_table.h"
+
+/* Defines ------------------------------------------------------------------*/
+#define CAN_DB_EXTENDED   0x80000000u  // Бит 31 ID сообщения (как в DBC): 29-битный ID
+
+// CAN_DB_Signal.flags
+#define CAN_DB_MOTOROLA   0x01  // Big-endian: data[0] - старший байт слова кадра
+#define CAN_DB_SIGNED     0x02  // Дополнительный код
+
+/**
+  * @brief  Сигнал из DBC: raw = (слово кадра >> shift) & mask,
+  *         значение = (raw * num / den + offset) / 10^decimals единиц unit.
+  *         Слово кадра - 8 байт данных как uint64_t: для Intel data[0]
+  *         в младшем байте, для Motorola - в старшем. Таблицу пишет
+  *         Tools/dbc2c.py, на устройстве битовые позиции не разбираются;
+  *         raw * num и результат у всех сигналов помещаются в int32.
+  *         В main декодер включается USE_CAN_DB: таблицы в дереве - образец.
+  */
+typedef struct {
+  uint8_t     shift;
+  uint8_t     bits;      // 1..32
+  uint8_t     flags;     // CAN_DB_MOTOROLA, CAN_DB_SIGNED
+  uint8_t     dlc;       // Сколько байт кадра нужно сигналу
+  uint32_t    mask;
+  uint8_t     unit;      // OBD_Unit
+  uint8_t     decimals;
+  int32_t     num;
+  int32_t     den;
+  int32_t     offset;    // В единицах результата (с учетом decimals)
+  const char *name;
+} CAN_DB_Signal;
+
+/**
+  * @brief  Сообщение из DBC и его сигналы can_db_signals[first..first+count)
+  */
+typedef struct {
+  uint32_t id;         // С CAN_DB_EXTENDED для 29 бит, таблица по возрастанию
+  uint16_t first;
+  uint8_t  count;
+} CAN_DB_Message;
+
+/**
+  * @brief  Последнее значение сигнала
+  */
+typedef struct {
+  int32_t  value;
+  uint8_t  valid;      // 1 - значение было хотя бы раз
+  uint32_t updated;    // HAL_GetTick() последнего значения
+  uint32_t updates;    // Принято значений (частота - по разности за интервал)
+} CAN_DB_Value;
+
+extern const CAN_DB_Message can_db_messages[CAN_DB_MESSAGE_COUNT];
+extern const CAN_DB_Signal  can_db_signals[CAN_DB_SIGNAL_COUNT];
+extern CAN_DB_Value         can_db_values[CAN_DB_SIGNAL_COUNT];
+
+/**
+  * @brief  Сообщение с идентификатором кадра, NULL - нет в DBC. 11 бит -
+  *         по таблице разбора (can_dispatch.h), 29 бит - двоичный поиск
+  */
+const CAN_DB_Message *CAN_DB_Find(uint32_t id, uint8_t extended);
+
+/**
+  * @brief  Значение сигнала из данных кадра.
+  * @retval 1 - значение в *value, 0 - кадр короче сигнала
+  */
+uint8_t CAN_DB_Decode(const CAN_DB_Signal *sig, const CAN_Frame *frame, int32_t *value);
+
+/**
+  * @brief  Обработка принятого кадра: все сигналы его сообщения в can_db_values.
+  * @retval 1 - сообщение есть в DBC
+  */
+uint8_t CAN_DB_On_Frame(const CAN_Frame *frame);
+
+/**
+  * @brief  Свежее значение сигнала с decimals знаками после запятой.
+  * @param  index: CAN_DB_<СИГНАЛ> из can_db_table.h
+  * @param  max_age_ms: Старше - вещание пропало, значение не выдается
+  * @retval 1 - значение в *value
+  */
+uint8_t CAN_DB_Get(uint16_t index, uint8_t decimals, uint32_t max_age_ms, int32_t *value);
+
+/**
+  * @brief  Диапазоны ID для фильтров MCP2515: по одному на сообщение
+  *         (соседние ID объединяются).
+  * @retval Количество диапазонов
+  */
+uint8_t CAN_DB_Filter_Ranges(CAN_Filter_Range *ranges, uint8_t max);
+
+#endif /* __CAN_DB_H */
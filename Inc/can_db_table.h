@@ -0,0 +1,19 @@
+/* Сгенерировано Tools/dbc2c.py из example.dbc - не править вручную */
+#ifndef __CAN_DB_TABLE_H
+#define __CAN_DB_TABLE_H
+
+#define CAN_DB_MESSAGE_COUNT  4
+#define CAN_DB_SIGNAL_COUNT   9
+
+// Индексы в can_db_signals[] и can_db_values[]
+#define CAN_DB_ENGINE_SPEED                    0  // ECM_Engine1.EngineSpeed
+#define CAN_DB_THROTTLE_POSITION               1  // ECM_Engine1.ThrottlePosition
+#define CAN_DB_ENGINE_TORQUE                   2  // ECM_Engine1.EngineTorque
+#define CAN_DB_COOLANT_TEMP                    3  // ECM_Engine2.CoolantTemp
+#define CAN_DB_OIL_TEMP                        4  // ECM_Engine2.OilTemp
+#define CAN_DB_BATTERY_VOLTAGE                 5  // ECM_Engine2.BatteryVoltage
+#define CAN_DB_VEHICLE_SPEED                   6  // ABS_Wheels.VehicleSpeed
+#define CAN_DB_STEERING_ANGLE                  7  // ABS_Wheels.SteeringAngle
+#define CAN_DB_ENGINE_SPEED_J1939              8  // EEC1.EngineSpeedJ1939
+
+#endif /* __CAN_DB_TABLE_H */
@@ -0,0 +1,41 @@
+#ifndef __CAN_DISPATCH_H
+#define __CAN_DISPATCH_H
+
+#include <stdint.h>
+#include "can_dispatch_table.h"
+
+/* Defines ------------------------------------------------------------------*/
+// Слот: обработчик в старших 4 битах, номер у обработчика - в младших 12
+#define CAN_DISPATCH_NONE    0  // ID вне таблицы
+#define CAN_DISPATCH_ISOTP   1  // Ответ ECU: номер в списке ID ISO-TP (--isotp)
+#define CAN_DISPATCH_DB      2  // Сообщение DBC: индекс в can_db_messages[]
+
+#define CAN_DISPATCH_SLOT(handler, arg) (((handler) << 12) | (arg))
+#define CAN_DISPATCH_HANDLER(slot)      ((slot) >> 12)
+#define CAN_DISPATCH_ARG(slot)          ((slot) & 0x0FFF)
+
+/*
+ * Таблицу пишет Tools/dbc2c.py по набору ID, известному при сборке:
+ * бит на каждый из 2048 11-битных ID, число единиц до каждого слова карты
+ * и слоты по возрастанию ID. 256 + 128 + 2 * (N + 1) байт flash.
+ */
+extern const uint32_t can_dispatch_bitmap[64];
+extern const uint16_t can_dispatch_rank[64];
+extern const uint16_t can_dispatch_slots[CAN_DISPATCH_STD_IDS + 1];
+
+/**
+  * @brief  Слот 11-битного ID за постоянное время и без ветвлений:
+  *         номер слота - единицы карты до бита ID (rank слова + popcount
+  *         младших бит), для ID вне таблицы индекс обнуляется маской.
+  * @retval Слот, CAN_DISPATCH_NONE - ID не интересен
+  */
+static inline uint16_t CAN_Dispatch_Std(uint32_t id)
+{
+  uint32_t word = can_dispatch_bitmap[(id >> 5) & 0x3F];
+  uint32_t hit = (word >> (id & 0x1F)) & 1;
+  uint32_t below = word & ((1u << (id & 0x1F)) - 1);
+
+  return can_dispatch_slots[(can_dispatch_rank[(id >> 5) & 0x3F] + __builtin_popcount(below) + 1) & -hit];
+}
+
+#endif /* __CAN_DISPATCH_H */
@@ -0,0 +1,8 @@
+/* Сгенерировано Tools/dbc2c.py из example.dbc - не править вручную */
+#ifndef __CAN_DISPATCH_TABLE_H
+#define __CAN_DISPATCH_TABLE_H
+
+#define CAN_DISPATCH_STD_IDS    11  // 11-битных ID в таблице
+#define CAN_DISPATCH_ISOTP_IDS  8  // Из них ответов ECU (ISO-TP)
+
+#endif /* __CAN_DISPATCH_TABLE_H */
@@ -0,0 +1,132 @@
+#ifndef __ISOTP_H
+#define __ISOTP_H
+
+#include <stdint.h>
+#include "mcp2515.h"
+
+/* Defines ------------------------------------------------------------------*/
+// Максимальная длина сообщения (ISO 15765-2 допускает до 4095 байт)
+#ifndef ISOTP_BUF_SIZE
+#define ISOTP_BUF_SIZE  512
+#endif
+
+#define ISOTP_N_BS_MS      1000  // Ожидание FC после FF/блока
+#define ISOTP_N_CR_MS      1000  // Ожидание очередного CF
+#define ISOTP_PADDING      0x00  // Заполнение кадров до 8 байт (ISO 15765-4)
+#define ISOTP_MAX_WFT      10    // Допустимое число FC WAIT подряд
+
+// Тип кадра (старший полубайт PCI)
+#define ISOTP_PCI_SF  0x00
+#define ISOTP_PCI_FF  0x10
+#define ISOTP_PCI_CF  0x20
+#define ISOTP_PCI_FC  0x30
+
+// Flow status
+#define ISOTP_FC_CTS    0x00
+#define ISOTP_FC_WAIT   0x01
+#define ISOTP_FC_OVFLW  0x02
+
+/**
+  * @brief  Результат приема/передачи
+  */
+typedef enum {
+  ISOTP_OK = 0,
+  ISOTP_BUSY,             // Идет прием/передача
+  ISOTP_ERR_TIMEOUT_BS,   // Нет FC (N_Bs)
+  ISOTP_ERR_TIMEOUT_CR,   // Нет CF (N_Cr)
+  ISOTP_ERR_WRONG_SN,     // Пропущен CF
+  ISOTP_ERR_OVERFLOW,     // Сообщение длиннее ISOTP_BUF_SIZE или FC OVFLW
+  ISOTP_ERR_FC,           // Неверный FC или слишком много WAIT
+} ISOTP_Result;
+
+/**
+  * @brief  Состояние конечных автоматов
+  */
+typedef enum {
+  ISOTP_IDLE = 0,
+  ISOTP_TX_WAIT_FC,  // FF или блок отправлены, ждем FC
+  ISOTP_TX_CF,       // Отправка CF
+  ISOTP_RX_CF,       // Прием CF
+  ISOTP_RX_DONE,     // Сообщение принято и ждет ISOTP_Receive
+} ISOTP_State;
+
+/**
+  * @brief  Канал ISO-TP: одна пара адресов, независимые автоматы TX и RX
+  */
+typedef struct {
+  // Адресация
+  uint32_t tx_id;        // Запросы
+  uint32_t rx_id;        // Ответы
+  uint32_t fc_id;        // Кому отправлять FC (для физической адресации = tx_id)
+  uint8_t  extended;     // 29-битные ID
+  // Параметры нашего FC
+  uint8_t  block_size;   // BS: 0 - без ограничения
+  uint8_t  st_min;       // STmin: 0 - на полной скорости шины
+  uint16_t n_bs_ms;
+  uint16_t n_cr_ms;
+
+  // Передача
+  ISOTP_State  tx_state;
+  ISOTP_Result tx_result;
+  uint16_t tx_len;
+  uint16_t tx_pos;
+  uint8_t  tx_sn;
+  uint8_t  tx_bs;        // BS получателя (0 - без ограничения)
+  uint8_t  tx_bs_left;
+  uint8_t  tx_wft;       // FC WAIT подряд
+  uint32_t tx_st_us;     // STmin получателя, мкс
+  uint32_t tx_timer;     // HAL_GetTick() начала ожидания FC
+  volatile uint32_t tx_last_us; // micros() | 1 ухода последнего CF на шину, 0 - CF еще в очереди
+  uint8_t  tx_buf[ISOTP_BUF_SIZE];
+
+  // Прием
+  ISOTP_State  rx_state;
+  ISOTP_Result rx_result;
+  uint16_t rx_len;
+  uint16_t rx_pos;
+  uint8_t  rx_sn;
+  uint8_t  rx_bs_left;
+  uint32_t rx_timer;     // HAL_GetTick() последнего FF/CF
+  uint8_t  rx_buf[ISOTP_BUF_SIZE];
+} ISOTP_Link;
+
+/**
+  * @brief  Настройка канала: BS = 0, STmin = 0, таймауты по умолчанию.
+  */
+void ISOTP_Init(ISOTP_Link *link, uint32_t tx_id, uint32_t rx_id, uint8_t extended);
+
+/**
+  * @brief  Начало передачи: SF сразу, для длинных сообщений FF и ожидание FC.
+  * @retval 1 - передача начата, 0 - канал занят или сообщение слишком длинное
+  */
+uint8_t ISOTP_Send(ISOTP_Link *link, const uint8_t *data, uint16_t len);
+
+/**
+  * @brief  Обработка принятого кадра (из MCP2515_RX_Pop).
+  * @retval 1 - кадр адресован каналу, 0 - чужой кадр
+  */
+uint8_t ISOTP_On_Frame(ISOTP_Link *link, const CAN_Frame *frame);
+
+/**
+  * @brief  Отправка CF с учетом BS/STmin и контроль таймаутов.
+  *         Вызывать в основном цикле как можно чаще.
+  */
+void ISOTP_Poll(ISOTP_Link *link);
+
+/**
+  * @brief  Забрать принятое сообщение (однократно).
+  * @param  data: Указатель на данные внутри канала (действителен до следующего FF/SF)
+  * @retval Длина сообщения, 0 - сообщения нет
+  */
+uint16_t ISOTP_Receive(ISOTP_Link *link, const uint8_t **data);
+
+/**
+  * @brief  Запрос и ожидание ответа (блокирующая обертка над автоматами).
+  *         Чужие кадры за время ожидания отбрасываются. NRC 0x78
+  *         (responsePending) продлевает ожидание до UDS_P2_STAR_MS.
+  * @retval Длина ответа, 0 - нет ответа или ошибка (link->rx_result/tx_result)
+  */
+uint16_t ISOTP_Request(ISOTP_Link *link, const uint8_t *req, uint16_t req_len,
+                       uint8_t *resp, uint16_t resp_max, uint32_t timeout_ms);
+
+#endif /* __ISOTP_H */
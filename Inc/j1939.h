@@ -0,0 +1,205 @@
+#ifndef __J1939_H
+#define __J1939_H
+
+#include <stdint.h>
+#include "mcp2515.h"
+#include "mcp2515_filter.h"
+#include "obd_pid.h"
+
+/* Defines ------------------------------------------------------------------*/
+#define J1939_BITRATE          250000u
+#define J1939_GLOBAL_ADDRESS   0xFF
+#define J1939_NULL_ADDRESS     0xFE  // Адрес не занят (cannot claim)
+#define J1939_TOOL_ADDRESS     0xF9  // Off-board diagnostic-service tool #1
+
+// PGN
+#define J1939_PGN_REQUEST      0xEA00  // 59904
+#define J1939_PGN_ADDRESS_CLAIM 0xEE00 // 60928
+#define J1939_PGN_TP_CM        0xEC00  // 60416, управление транспортом
+#define J1939_PGN_TP_DT        0xEB00  // 60160, данные транспорта
+#define J1939_PGN_EEC2         0xF003  // 61443, педаль акселератора
+#define J1939_PGN_EEC1         0xF004  // 61444, обороты двигателя
+#define J1939_PGN_ET1          0xFEEE  // 65262, температуры двигателя
+#define J1939_PGN_EFLP1        0xFEEF  // 65263, давления жидкостей двигателя
+#define J1939_PGN_CCVS         0xFEF1  // 65265, скорость автомобиля
+#define J1939_PGN_DM1          0xFECA  // 65226, активные DTC и лампы
+
+// Управляющий байт TP.CM
+#define J1939_TP_RTS           16
+#define J1939_TP_CTS           17
+#define J1939_TP_EOMA          19
+#define J1939_TP_BAM           32
+#define J1939_TP_ABORT         255
+
+// Тайминги SAE J1939-21
+#define J1939_T1_MS            750   // Между кадрами BAM
+#define J1939_T2_MS            1250  // Данные после CTS
+#define J1939_CLAIM_MS         250   // Ожидание возражений на Address Claimed
+
+// NAME (J1939-81): функция - биты 40-47, номер экземпляра - биты 0-20,
+// остальные поля (производитель, система, группа отрасли) нулевые
+#define J1939_FUNCTION_TOOL    129   // Off-board diagnostic-service tool
+#define J1939_NAME(function, identity) \
+  (((uint64_t)(function) << 40) | ((uint64_t)(identity) & 0x1FFFFF))
+
+#define J1939_TP_SIZE          256   // Сообщение транспорта (DM1 - до 61 DTC)
+#define J1939_TP_SESSIONS      3     // Одновременных сборок (BAM разных источников, CMDT)
+#define J1939_CTS_PACKETS      16    // Пакетов на один CTS
+#define J1939_DM1_MAX          8     // DTC, сохраняемых из DM1
+
+/**
+  * @brief  Поля 29-битного идентификатора J1939
+  */
+typedef struct {
+  uint8_t  priority;
+  uint32_t pgn;        // Для PDU1 (PF < 240) - без адреса назначения
+  uint8_t  da;         // Адрес назначения, для PDU2 - J1939_GLOBAL_ADDRESS
+  uint8_t  sa;         // Адрес источника
+} J1939_ID;
+
+/**
+  * @brief  SPN в PGN: значение = (raw * num / den + offset) / 10^decimals
+  *         единиц unit, raw - bits бит с бита shift от байта pos
+  *         (little-endian, как все многобайтные поля J1939).
+  */
+typedef struct {
+  uint16_t    spn;
+  uint16_t    pgn;       // Все PGN таблицы - PDU2 (< 0x10000)
+  uint8_t     pos;
+  uint8_t     shift;
+  uint8_t     bits;
+  uint8_t     unit;      // OBD_Unit
+  uint8_t     decimals;
+  int32_t     num;
+  int32_t     den;
+  int32_t     offset;    // В единицах результата (с учетом decimals)
+  const char *name;
+} J1939_SPN_Field;
+
+/**
+  * @brief  Отслеживаемый SPN и его последнее значение
+  */
+typedef struct {
+  uint16_t spn;
+  uint8_t  sa;         // Источник, J1939_GLOBAL_ADDRESS - любой
+  // Состояние (заполняет стек)
+  uint8_t  valid;      // 1 - значение есть, 0 - еще не было или "нет данных" (0xFF..)
+  uint8_t  from;       // Источник последнего значения
+  int32_t  value;
+  uint32_t updated;    // HAL_GetTick() последнего значения
+} J1939_Signal;
+
+/**
+  * @brief  DTC из DM1: SPN, FMI (вид неисправности), счетчик появлений
+  */
+typedef struct {
+  uint32_t spn;
+  uint8_t  fmi;
+  uint8_t  oc;
+} J1939_DTC;
+
+/**
+  * @brief  Последний DM1: лампы (0 - выкл, 1 - вкл, 3 - нет данных) и DTC
+  */
+typedef struct {
+  uint8_t   mil;       // Malfunction indicator lamp
+  uint8_t   red_stop;
+  uint8_t   amber;     // Amber warning lamp
+  uint8_t   protect;
+  uint8_t   count;     // DTC в сообщении (сохранено не больше J1939_DM1_MAX)
+  J1939_DTC dtc[J1939_DM1_MAX];
+  uint8_t   sa;
+  uint32_t  updated;   // HAL_GetTick() приема, 0 - DM1 еще не было
+} J1939_DM1;
+
+/**
+  * @brief  Сборка многопакетного сообщения (BAM или RTS/CTS)
+  */
+typedef struct {
+  uint8_t  active;
+  uint8_t  bam;        // 1 - широковещательное, без CTS
+  uint8_t  sa;
+  uint32_t pgn;
+  uint16_t size;
+  uint8_t  packets;
+  uint8_t  next;       // Ожидаемый порядковый номер TP.DT (с 1)
+  uint8_t  window_end; // CMDT: последний пакет текущего CTS
+  uint8_t  max_cts;    // CMDT: предел пакетов на CTS от отправителя
+  uint32_t deadline;   // HAL_GetTick() таймаута очередного пакета
+  uint8_t  data[J1939_TP_SIZE];
+} J1939_TP_Session;
+
+typedef void (*J1939_PGN_Callback)(uint32_t pgn, uint8_t sa, const uint8_t *data, uint16_t len);
+
+/**
+  * @brief  Стек J1939: пассивный разбор широковещательных PGN,
+  *         сборка транспортных сообщений, свой адрес на шине
+  */
+typedef struct {
+  uint64_t      name;          // NAME для Address Claimed (меньше - приоритетнее)
+  uint8_t       address;       // Свой адрес, J1939_NULL_ADDRESS - не занят
+  uint8_t       claiming;      // Ждем возражений J1939_CLAIM_MS
+  uint32_t      claim_tick;
+  J1939_Signal *signals;
+  uint8_t       signal_count;
+  J1939_DM1     dm1;
+  uint8_t       dm1_sa;        // Чей DM1 сохранять, J1939_GLOBAL_ADDRESS - любой
+  J1939_PGN_Callback on_pgn;   // Каждое принятое сообщение (может быть NULL)
+  J1939_TP_Session tp[J1939_TP_SESSIONS];
+  uint32_t      messages;      // Разобрано сообщений (с собранными транспортом)
+  uint32_t      tp_aborts;     // Сборок, брошенных по таймауту или Abort
+} J1939_Stack;
+
+/**
+  * @brief  Разбор 29-битного идентификатора
+  */
+void J1939_Parse_ID(uint32_t can_id, J1939_ID *id);
+
+/**
+  * @brief  29-битный идентификатор (для PDU1 da подставляется в PS)
+  */
+uint32_t J1939_Make_ID(uint8_t priority, uint32_t pgn, uint8_t da, uint8_t sa);
+
+/**
+  * @brief  SPN в таблице (двоичный поиск), NULL - не описан
+  */
+const J1939_SPN_Field *J1939_SPN_Find(uint16_t spn);
+
+/**
+  * @brief  Значение SPN из данных его PGN.
+  * @retval 1 - значение в *value, 0 - данных мало или "ошибка/нет данных"
+  */
+uint8_t J1939_SPN_Decode(const J1939_SPN_Field *field, const uint8_t *data, uint16_t len, int32_t *value);
+
+/**
+  * @brief  Разбор DM1 [лампы, мигание, (SPN FMI OC) x N].
+  * @retval Количество DTC в сообщении
+  */
+uint8_t J1939_Parse_DM1(const uint8_t *data, uint16_t len, J1939_DM1 *dm1);
+
+/**
+  * @brief  Начальное состояние. signals - таблица отслеживаемых SPN.
+  * @param  address: Желаемый адрес, J1939_NULL_ADDRESS - только прием
+  *         (без адреса RTS/CTS к нам не идут, запросов стек не шлет)
+  */
+void J1939_Init(J1939_Stack *j, uint64_t name, uint8_t address, J1939_Signal *signals, uint8_t count);
+
+/**
+  * @brief  Диапазоны ID для фильтров MCP2515: PGN таблицы SPN, DM1,
+  *         транспорт и адресация (с приоритетами по умолчанию J1939-71).
+  * @retval Количество диапазонов
+  */
+uint8_t J1939_Filter_Ranges(const J1939_Stack *j, CAN_Filter_Range *ranges, uint8_t max);
+
+/**
+  * @brief  Обработка принятого кадра.
+  * @retval 1 - кадр J1939 (29 бит) обработан
+  */
+uint8_t J1939_On_Frame(J1939_Stack *j, const CAN_Frame *frame);
+
+/**
+  * @brief  Таймауты сборок и Address Claimed. Вызывать в основном цикле.
+  */
+void J1939_Task(J1939_Stack *j);
+
+#endif /* __J1939_H */
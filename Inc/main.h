@@ -32,6 +32,7 @@ extern "C" {
 /* Private includes ----------------------------------------------------------*/
 /* USER CODE BEGIN Includes */
 void print(const char *format, ...);
+uint32_t micros(void);
 /* USER CODE END Includes */
 
 /* Exported types ------------------------------------------------------------*/
@@ -59,6 +60,9 @@ void Error_Handler(void);
 /* Private defines -----------------------------------------------------------*/
 #define CS__Pin GPIO_PIN_4
 #define CS__GPIO_Port GPIOA
+#define MCP_INT_Pin GPIO_PIN_1
+#define MCP_INT_GPIO_Port GPIOB
+#define MCP_INT_EXTI_IRQn EXTI1_IRQn
 
 /* USER CODE BEGIN Private defines */
 
@@ -1,4 +1,9 @@
+#ifndef __MCP2515_H
+#define __MCP2515_H
+
 #include <stdint.h>
+#include "mcp2515_filter.h"
+#include "mcp2515_timing.h"
 
 /* Defines ------------------------------------------------------------------*/
 // Команды MCP2515
@@ -16,10 +21,35 @@
 #define MCP2515_CMD_RTS_TX2   0x84  // Запрос отправки для TXB2
 #define MCP2515_CMD_RTS_ALL   0x87  // Запрос отправки для всех буферов
 
+#define MCP2515_CMD_RTS_TX(n)  (MCP2515_CMD_RTS | (1u << (n))) // RTS для TXBn
+
+// Команды LOAD TX BUFFER (запись буфера одной транзакцией)
+#define MCP2515_CMD_LOAD_TX0_ID  0x40  // TXB0, начиная с TXB0SIDH
+#define MCP2515_CMD_LOAD_TX0_D0  0x41  // TXB0, начиная с TXB0D0
+#define MCP2515_CMD_LOAD_TX1_ID  0x42  // TXB1, начиная с TXB1SIDH
+#define MCP2515_CMD_LOAD_TX1_D0  0x43  // TXB1, начиная с TXB1D0
+#define MCP2515_CMD_LOAD_TX2_ID  0x44  // TXB2, начиная с TXB2SIDH
+#define MCP2515_CMD_LOAD_TX2_D0  0x45  // TXB2, начиная с TXB2D0
+#define MCP2515_CMD_LOAD_TX_ID(n)  (MCP2515_CMD_LOAD_TX0_ID + 2 * (n))
+
 // Команды чтения с автоматическим инкрементом
 #define MCP2515_CMD_READ_RX0  0x90  // Чтение RXB0 с автоинкрементом
 #define MCP2515_CMD_READ_RX1  0x94  // Чтение RXB1 с автоинкрементом
 
+// Команды чтения статуса
+#define MCP2515_CMD_READ_STATUS 0xA0  // Флаги RXnIF/TXnIF и TXREQ одной командой
+#define MCP2515_CMD_RX_STATUS   0xB0  // Статус приема и номер сработавшего фильтра
+
+// Биты ответа READ STATUS
+#define MCP2515_STATUS_RX0IF   0x01
+#define MCP2515_STATUS_RX1IF   0x02
+#define MCP2515_STATUS_TX0REQ  0x04
+#define MCP2515_STATUS_TX0IF   0x08
+#define MCP2515_STATUS_TX1REQ  0x10
+#define MCP2515_STATUS_TX1IF   0x20
+#define MCP2515_STATUS_TX2REQ  0x40
+#define MCP2515_STATUS_TX2IF   0x80
+
 // Команды изменения битов
 #define MCP2515_CMD_BITMOD    0x05  // Изменение отдельных битов
 
@@ -31,6 +61,7 @@
 #define MCP2515_REG_CNF3          0x28
 #define MCP2515_REG_CANINTE       0x2B
 #define MCP2515_REG_CANINTF       0x2C
+#define MCP2515_REG_EFLG          0x2D
 #define MCP2515_REG_TXB0CTRL      0x30
 #define MCP2515_REG_TXB0SIDH      0x31
 #define MCP2515_REG_TXB0SIDL      0x32
@@ -40,6 +71,17 @@
 #define MCP2515_REG_RXB0SIDH      0x61
 #define MCP2515_REG_RXB0DLC       0x65
 #define MCP2515_REG_RXB0D0        0x66
+#define MCP2515_REG_RXB1CTRL      0x70
+#define MCP2515_REG_RXB1SIDH      0x71
+
+// Биты RXBnCTRL
+#define MCP2515_RXB_RXM_FILTER    0x00  // Прием по фильтрам
+#define MCP2515_RXB_RXM_ANY       0x60  // Фильтры выключены, принимать все
+#define MCP2515_RXB0_BUKT         0x04  // Rollover: при занятом RXB0 кадр уходит в RXB1
+
+// Биты EFLG
+#define MCP2515_EFLG_RX0OVR       0x40  // Переполнение RXB0
+#define MCP2515_EFLG_RX1OVR       0x80  // Переполнение RXB1
 
 // CAN ID для OBD (ISO 15765-4)
 #define CAN_OBD_REQUEST_ID        0x7DF   // Широковещательный запрос
@@ -147,6 +189,81 @@
 #define MCP2515_REG_TXB2D5    0x5B  // Data Byte 5
 #define MCP2515_REG_TXB2D6    0x5C  // Data Byte 6
 #define MCP2515_REG_TXB2D7    0x5D  // Data Byte 7
+/**
+  * @brief  CAN кадр (прием/передача)
+  */
+typedef struct {
+  uint32_t id;        // Идентификатор: 11 или 29 бит
+  uint8_t  extended;  // 1 - расширенный (29-битный) ID
+  uint8_t  rtr;       // 1 - удаленный запрос (Remote Frame)
+  uint8_t  dlc;       // Длина данных 0..8
+  uint8_t  data[8];   // Данные
+  uint32_t timestamp; // Время приема, мкс (micros())
+} CAN_Frame;
+
+// Размер кольцевого буфера принятых кадров (степень двойки)
+#define MCP2515_RX_RING_SIZE  32
+
+// Очередь передачи: по одной очереди на каждый уровень приоритета TXP
+#define MCP2515_TX_PRIO_LEVELS      4    // TXP = 0 (низший) .. 3 (высший)
+#define MCP2515_TX_QUEUE_SIZE       8    // Кадров в очереди одного приоритета
+#define MCP2515_TX_PRIO_DEFAULT     1
+#define MCP2515_TX_TIMEOUT_DEFAULT  100  // мс до отмены кадра, не ушедшего в шину
+
+// Биты TXBnCTRL
+#define MCP2515_TXB_TXP_MASK  0x03
+#define MCP2515_TXB_TXREQ     0x08
+#define MCP2515_CANCTRL_ABAT  0x10  // Отмена всех ожидающих передач
+
+// Биты регистров CANINTE/CANINTF
+#define MCP2515_INT_RX0I   0x01
+#define MCP2515_INT_RX1I   0x02
+#define MCP2515_INT_TX0I   0x04
+#define MCP2515_INT_TX1I   0x08
+#define MCP2515_INT_TX2I   0x10
+#define MCP2515_INT_ERRI   0x20
+#define MCP2515_INT_WAKI   0x40
+#define MCP2515_INT_MERRF  0x80
+
+/**
+  * @brief  Статистика приема
+  */
+typedef struct {
+  uint32_t rx_frames;      // Кадров прочитано из MCP2515
+  uint32_t rx_ring_drops;  // Кадров потеряно из-за переполнения кольцевого буфера
+  uint32_t rx_overflow[2]; // Переполнения RXB0/RXB1 (EFLG RX0OVR/RX1OVR)
+  uint32_t msg_errors;     // Ошибки на шине (CANINTF MERRF)
+  uint32_t tx_frames;      // Кадров передано
+  uint32_t tx_timeouts;    // Кадров отменено по таймауту
+  uint32_t tx_queue_full;  // Отказов постановки в очередь
+} MCP2515_Stats;
+
+extern volatile MCP2515_Stats mcp2515_stats;
+
+// Режимы работы (REQOP в CANCTRL, OPMOD в CANSTAT)
+#define MCP2515_MODE_NORMAL    0x00
+#define MCP2515_MODE_LOOPBACK  0x40
+#define MCP2515_MODE_LISTEN    0x60  // Только прием, без ACK и кадров ошибки
+#define MCP2515_MODE_CONFIG    0x80
+#define MCP2515_MODE_MASK      0xE0
+
+// Автоопределение скорости и адресации
+#define MCP2515_DETECT_WINDOW_MS  40  // Прослушивание на одной скорости
+#define MCP2515_DETECT_FRAMES     4   // Кадров без ошибок, достаточных для выбора скорости
+#define MCP2515_DETECT_ERRORS     3   // Ошибок без кадров, после которых скорость отбрасывается
+#define MCP2515_DETECT_PROBE_MS   50  // Ожидание ответа на пробный запрос (P2 CAN)
+
+/**
+  * @brief  Результат автоопределения
+  */
+typedef struct {
+  uint32_t bitrate;   // Скорость шины, 0 - не определена
+  uint8_t  extended;  // 0 - ISO 15765-4 11 бит, 1 - 29 бит
+  uint8_t  answered;  // 1 - адресация подтверждена ответом ECU
+  uint16_t frames;    // Правильных кадров при прослушивании на выбранной скорости
+  uint16_t errors;    // Ошибок (MERRF) на выбранной скорости
+} MCP2515_Detect_Result;
+
 /**
   * @brief  Чтение одного регистра MCP2515.
   * @param  reg_addr: Адрес регистра для чтения (например, 0x00 - REG_CANSTAT)
@@ -170,11 +287,150 @@ void MCP2515_Write_Register(uint8_t reg_addr,uint8_t reg_data);
   */
 void MCP2515_Read_Registers(uint8_t start_reg_addr, uint8_t *buffer, uint8_t count);
 
+/**
+  * @brief  Последовательная запись нескольких регистров MCP2515 (одна транзакция).
+  * @param  start_reg_addr: Адрес первого регистра
+  * @param  data: Данные для записи
+  * @param  count: Количество байт
+  */
+void MCP2515_Write_Registers(uint8_t start_reg_addr, const uint8_t *data, uint8_t count);
+
+/**
+  * @brief  Изменение отдельных битов регистра (BIT MODIFY).
+  * @param  reg_addr: Адрес регистра (только регистры с поддержкой BIT MODIFY)
+  * @param  mask: Маска изменяемых битов
+  * @param  value: Новые значения битов
+  */
+void MCP2515_Bit_Modify(uint8_t reg_addr, uint8_t mask, uint8_t value);
+
+/**
+  * @brief  Загрузка TX буфера одной транзакцией (LOAD TX BUFFER).
+  *         ID, DLC и данные передаются за один CS-low, опционально сразу RTS.
+  * @param  txb: Номер буфера 0..2
+  * @param  can_id: Идентификатор (11 или 29 бит)
+  * @param  extended: 0 - стандартный ID, 1 - расширенный (29 бит)
+  * @param  dlc: Длина данных 0..8
+  * @param  data: Данные (может быть NULL при dlc == 0)
+  * @param  send: 1 - сразу запросить отправку (RTS)
+  */
+void MCP2515_Load_TX_Buffer(uint8_t txb, uint32_t can_id, uint8_t extended,
+                            uint8_t dlc, const uint8_t *data, uint8_t send);
+
+/**
+  * @brief  Запрос отправки (RTS) для буферов по маске (бит 0 - TXB0 ... бит 2 - TXB2).
+  */
+void MCP2515_Request_To_Send(uint8_t txb_mask);
+
+/**
+  * @brief  Отправка кадра через очередь передачи (приоритет и таймаут по умолчанию).
+  * @retval 1 - кадр в очереди, 0 - очередь переполнена
+  */
+uint8_t MCP2515_Send_Frame(uint32_t can_id, uint8_t extended, uint8_t dlc, const uint8_t *data);
+
+/**
+  * @brief  Постановка кадра в очередь передачи (без ожидания).
+  *         Кадры раздаются в TXB0..TXB2 с приоритетом TXP = priority.
+  *         Кадры одного приоритета уходят строго в порядке постановки.
+  * @param  frame: Кадр для передачи
+  * @param  priority: 0 (низший) .. 3 (высший)
+  * @param  timeout_ms: Время ожидания арбитража, после которого кадр отменяется
+  * @retval 1 - кадр в очереди, 0 - очередь переполнена
+  */
+uint8_t MCP2515_TX_Enqueue(const CAN_Frame *frame, uint8_t priority, uint16_t timeout_ms);
+
+/**
+  * @brief  MCP2515_TX_Enqueue с отметкой ухода кадра: когда буфер MCP2515
+  *         освобождается (кадр передан, отменен по таймауту или
+  *         MCP2515_TX_Abort_All), в *sent_us пишется micros() | 1 (не 0).
+  *         Пишется и из прерывания - переменная должна жить до этого момента.
+  * @retval 1 - кадр в очереди, 0 - очередь переполнена (*sent_us не тронут)
+  */
+uint8_t MCP2515_TX_Enqueue_Tracked(const CAN_Frame *frame, uint8_t priority, uint16_t timeout_ms,
+                                   volatile uint32_t *sent_us);
+
+/**
+  * @brief  Обслуживание передачи: завершение отправленных кадров (TXREQ/TXnIF),
+  *         отмена по таймауту, загрузка свободных буферов из очереди.
+  *         Вызывается из основного цикла и из прерывания по TXnIF.
+  */
+void MCP2515_TX_Service(void);
+
+/**
+  * @brief  Отмена всех передач (ABAT) и очистка очереди.
+  */
+void MCP2515_TX_Abort_All(void);
+
+/**
+  * @brief  Количество кадров в очереди и в буферах MCP2515.
+  */
+uint8_t MCP2515_TX_Pending(void);
+
+/**
+  * @brief  Чтение статуса командой READ STATUS (флаги RXnIF/TXnIF, TXREQ).
+  * @retval Байт статуса (биты MCP2515_STATUS_*)
+  */
+uint8_t MCP2515_Read_Status(void);
+
+/**
+  * @brief  Чтение приемного буфера одной транзакцией (READ RX BUFFER).
+  *         ID, DLC и данные читаются за один CS-low, флаг RXnIF
+  *         сбрасывается контроллером автоматически при подъеме CS.
+  * @param  rxb: Номер буфера 0 или 1
+  * @param  frame: Принятый кадр
+  */
+void MCP2515_Read_RX_Buffer(uint8_t rxb, CAN_Frame *frame);
+
+/**
+  * @brief  Прием кадра без ожидания: READ STATUS + READ RX BUFFER.
+  *         Буферы RXB0/RXB1 обслуживаются в порядке прихода кадров.
+  * @param  frame: Принятый кадр
+  * @retval 1 - кадр принят, 0 - буферы пусты
+  */
+uint8_t MCP2515_Receive_Frame(CAN_Frame *frame);
+
+/**
+  * @brief  Обработчик прерывания по линии INT (вызывается из HAL_GPIO_EXTI_Callback).
+  *         Вычитывает RXB0/RXB1 в кольцевой буфер в порядке прихода кадров
+  *         и считает переполнения буферов MCP2515.
+  */
+void MCP2515_IRQ_Handler(void);
+
+/**
+  * @brief  Извлечение кадра из кольцевого буфера приема (без ожидания).
+  * @param  frame: Принятый кадр
+  * @retval 1 - кадр извлечен, 0 - буфер пуст
+  */
+uint8_t MCP2515_RX_Pop(CAN_Frame *frame);
+
+/**
+  * @brief  Количество кадров, ожидающих в кольцевом буфере приема.
+  */
+uint16_t MCP2515_RX_Available(void);
+
+/**
+  * @brief  Выбор скорости шины для кварца MCP2515_OSC_HZ (125k-1M и др.).
+  *         Применяется при следующей инициализации, а если контроллер уже
+  *         работает - сразу (очередь передачи при этом сбрасывается).
+  * @retval 1 - успешно, 0 - скорость недостижима с этим кварцем
+  */
+uint8_t MCP2515_Set_Bitrate(uint32_t bitrate);
+
+/**
+  * @brief  Текущая скорость шины, бит/с
+  */
+uint32_t MCP2515_Get_Bitrate(void);
+
 /*
-  *         Без использования прерываний (режим опроса).
+  *         Прием по прерыванию INT: RXB0/RXB1 вычитываются в кольцевой буфер.
   */
 void MCP2515_Init_ISO15765(void);
 
+/**
+  * @brief  Пассивный прием всех кадров (режим сниффера): listen-only,
+  *         фильтры открыты, прием по прерыванию INT, ошибки в msg_errors.
+  */
+void MCP2515_Init_Listen_Only(void);
+
 /*
   * Инициализация MCP2515 для ISO 27145-4 (WWH-OBD)
   * 29-битные идентификаторы, фильтрация на ответы ECU
@@ -190,9 +446,38 @@ void MCP2515_Send_ISO27145_TXB0_Extended(uint32_t can_id, uint8_t *data, uint8_t
   */
 void MCP2515_Init_With_Filter(void);
 
+/**
+  * @brief  Автоопределение скорости и ширины ID. Сначала прослушивание
+  *         (listen-only) на 500k/250k/1M/125k: правильные кадры против MERRF.
+  *         Затем пробный запрос 01 00 на 0x7DF и 0x18DB33F1; если трафика
+  *         не было - на 500k и 250k (ISO 15765-4). Не дольше ~0.4 с.
+  * @param  result: Результат (bitrate = 0 - шина не найдена)
+  * @retval 1 - скорость определена, 0 - нет
+  */
+uint8_t MCP2515_Auto_Detect(MCP2515_Detect_Result *result);
+
+/**
+  * @brief  Автоопределение и инициализация: MCP2515_Init_ISO15765 для 11-битной
+  *         адресации или MCP2515_Init_ISO27145 для 29-битной. Если шина
+  *         не найдена - MCP2515_Init_ISO15765 на MCP2515_BITRATE_DEFAULT.
+  * @param  result: Результат автоопределения (может быть NULL)
+  * @retval 1 - скорость определена, 0 - используется скорость по умолчанию
+  */
+uint8_t MCP2515_Init_Auto(MCP2515_Detect_Result *result);
 
 /**
-  * @brief  Проверка и чтение принятого сообщения (режим опроса)
+  * @brief  Инициализация с аппаратными фильтрами, подобранными под набор ID
+  *         (см. MCP2515_Filter_Solve). Прием по прерыванию INT.
+  * @param  ranges: Нужные 11- и 29-битные идентификаторы/диапазоны
+  * @param  count: Количество диапазонов
+  * @param  report: Подобранные маски/фильтры и оценка лишнего приема (может быть NULL)
+  * @retval 1 - успешно, 0 - набор ID не раскладывается (слишком много шаблонов)
+  */
+uint8_t MCP2515_Init_Filtered(const CAN_Filter_Range *ranges, uint8_t count, MCP2515_Filter_Config *report);
+
+
+/**
+  * @brief  Ожидание ответа с нужным PID в кольцевом буфере приема
   * @param  data: указатель на буфер для данных (минимум 8 байт)
   * @retval 0 - сообщения нет, >0 - количество принятых байт
   */
@@ -200,6 +485,7 @@ uint8_t MCP2515_Read_Message_Polling(uint8_t *data, uint8_t pid, uint32_t timeou
 
 /**
   * @brief  Отправка OBD2 запроса на получение RPM
+  *         (после MCP2515_Init_ISO27145 запрос на 0x7DF уходит на 0x18DB33F1)
   */
 void MCP2515_Send_OBD_Request(uint16_t can_id, uint8_t pid);
 
@@ -228,8 +514,12 @@ DTC_Status Parse_DTC_Status(uint8_t *data, uint8_t length);
 
 /**
   * @brief  Обработка отрицательного ответа
+  * @param  data: Одиночный кадр [PCI 7F SID NRC ...]
+  * @retval NRC, 0 - кадр не отрицательный ответ (классификация - UDS_Classify)
   */
 int Handle_Negative_Response(uint8_t *data, uint8_t length);
 
 // Пример использования в main.c или в другом месте
-void example_usage(void);
\ No newline at end of file
+void example_usage(void);
+
+#endif /* __MCP2515_H */
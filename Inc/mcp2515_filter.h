@@ -0,0 +1,57 @@
+#ifndef __MCP2515_FILTER_H
+#define __MCP2515_FILTER_H
+
+#include <stdint.h>
+
+/* Defines ------------------------------------------------------------------*/
+// Максимум элементарных шаблонов после разбиения диапазонов на выровненные блоки
+#define MCP2515_FILTER_MAX_PATTERNS  32
+
+/**
+  * @brief  Диапазон нужных идентификаторов (включительно).
+  *         Для одного ID id_from == id_to.
+  */
+typedef struct {
+  uint32_t id_from;
+  uint32_t id_to;
+  uint8_t  extended;  // 0 - 11-битные ID, 1 - 29-битные ID
+} CAN_Filter_Range;
+
+/**
+  * @brief  Результат подбора масок/фильтров и оценка лишнего приема.
+  *         Идентификаторы хранятся в едином 29-битном виде: для стандартного
+  *         кадра ID сдвинут на 18 бит влево (как SID в регистрах MCP2515).
+  */
+typedef struct {
+  uint32_t mask[2];          // RXM0 (для RXF0-RXF1), RXM1 (для RXF2-RXF5)
+  uint32_t filter[6];        // RXF0..RXF5
+  uint8_t  filter_ext[6];    // EXIDE для каждого фильтра
+  uint32_t wanted_std;       // Нужных 11-битных ID
+  uint32_t wanted_ext;       // Нужных 29-битных ID
+  uint32_t accepted_std;     // Принимается 11-битных ID (точно)
+  uint32_t accepted_ext;     // Принимается 29-битных ID (оценка сверху)
+  uint32_t false_accept_ppm_std; // Доля лишних 11-битных ID среди ненужных, ppm
+  uint32_t false_accept_ppm_ext; // То же для 29-битных ID, ppm
+} MCP2515_Filter_Config;
+
+/**
+  * @brief  Подбор RXM0/RXM1 и RXF0-RXF5, пропускающих все нужные ID
+  *         с минимумом лишних. Эвристика: диапазоны разбиваются на выровненные
+  *         блоки, блоки жадно объединяются, на каждом шаге перебираются все
+  *         раскладки по группам RXB0 (2 фильтра) и RXB1 (4 фильтра).
+  *         Стоимость - доля пропускаемых лишних ID своего типа
+  *         (равномерный трафик по ID).
+  * @param  ranges: Нужные идентификаторы
+  * @param  count: Количество диапазонов
+  * @param  cfg: Результат
+  * @retval 1 - успешно, 0 - слишком много шаблонов (MCP2515_FILTER_MAX_PATTERNS)
+  */
+uint8_t MCP2515_Filter_Solve(const CAN_Filter_Range *ranges, uint8_t count, MCP2515_Filter_Config *cfg);
+
+/**
+  * @brief  Запись масок и фильтров в MCP2515 тремя последовательными WRITE
+  *         (RXF0-RXF2, RXF3-RXF5, RXM0-RXM1). Только в режиме конфигурации.
+  */
+void MCP2515_Filter_Apply(const MCP2515_Filter_Config *cfg);
+
+#endif /* __MCP2515_FILTER_H */
@@ -0,0 +1,58 @@
+#ifndef __MCP2515_TIMING_H
+#define __MCP2515_TIMING_H
+
+#include <stdint.h>
+
+/* Defines ------------------------------------------------------------------*/
+// Частота кварца MCP2515 (можно переопределить в настройках проекта)
+#ifndef MCP2515_OSC_HZ
+#define MCP2515_OSC_HZ  8000000u
+#endif
+
+// Скорость шины по умолчанию
+#ifndef MCP2515_BITRATE_DEFAULT
+#define MCP2515_BITRATE_DEFAULT  500000u
+#endif
+
+// Целевая точка выборки, промилле (CiA 301: 87.5%, для 1 Мбит/с - 75%)
+#define MCP2515_SAMPLE_POINT(bitrate)  ((bitrate) > 800000u ? 750u : 875u)
+
+// Упаковка сегментов в CNF1-CNF3 (длительности в Tq, BTLMODE=1, SAM=0)
+#define MCP2515_CNF1(brp, sjw)   ((uint8_t)((((sjw) - 1u) << 6) | (brp)))
+#define MCP2515_CNF2(prop, ps1)  ((uint8_t)(0x80u | (((ps1) - 1u) << 3) | ((prop) - 1u)))
+#define MCP2515_CNF3(ps2)        ((uint8_t)((ps2) - 1u))
+
+/**
+  * @brief  Параметры битового интервала: Tq = 2 * (brp + 1) / Fosc,
+  *         бит = 1 (SyncSeg) + prop + ps1 + ps2 квантов.
+  */
+typedef struct {
+  uint32_t osc_hz;
+  uint32_t bitrate;
+  uint8_t  brp;           // 0..63
+  uint8_t  prop;          // 1..8 Tq
+  uint8_t  ps1;           // 1..8 Tq
+  uint8_t  ps2;           // 2..8 Tq
+  uint8_t  sjw;           // 1..4 Tq
+  uint16_t sample_point;  // Точка выборки, промилле
+  uint8_t  cnf1;
+  uint8_t  cnf2;
+  uint8_t  cnf3;
+} MCP2515_Bit_Timing;
+
+/**
+  * @brief  Расчет битового интервала: перебор BRP с точным делением частоты,
+  *         выбор точки выборки, ближайшей к MCP2515_SAMPLE_POINT, при равенстве -
+  *         больше квантов на бит. SJW максимальный (до 4 Tq, меньше PS2).
+  * @retval 1 - успешно, 0 - скорость недостижима с этим кварцем
+  */
+uint8_t MCP2515_Calc_Bit_Timing(uint32_t osc_hz, uint32_t bitrate, MCP2515_Bit_Timing *timing);
+
+/**
+  * @brief  Параметры из таблицы, рассчитанной на этапе компиляции
+  *         (8/16/20 МГц, 125k-1M), для остальных сочетаний - расчет.
+  * @retval 1 - успешно, 0 - скорость недостижима с этим кварцем
+  */
+uint8_t MCP2515_Get_Bit_Timing(uint32_t osc_hz, uint32_t bitrate, MCP2515_Bit_Timing *timing);
+
+#endif /* __MCP2515_TIMING_H */
@@ -0,0 +1,58 @@
+#ifndef __NVSTORE_H
+#define __NVSTORE_H
+
+#include <stdint.h>
+
+/* Defines ------------------------------------------------------------------*/
+/*
+  * Журнал записей во flash, сектор 3 (16 КБ, линкер-скрипт обходит его).
+  * Записи дописываются подряд, по словам:
+  *   [NV_MAGIC, 2] [type] [len] [key, 4] [data, len до кратного 4] [crc32, 4]
+  * Действует последняя запись с данным type/key. Стирание сектора (сотни мс,
+  * выполнение из flash и прерывания стоят) - только при старте, в NV_Compact;
+  * в работе полный журнал записи не принимает. Хранятся только кэши,
+  * которые можно получить заново.
+  */
+#ifndef NV_BASE
+#define NV_BASE        0x0800C000u
+#define NV_SIZE        0x4000u
+#define NV_SECTOR      FLASH_SECTOR_3
+#endif
+#define NV_RESERVE     0x1000u  // Меньше свободного места при старте - журнал сжимается
+#define NV_COMPACT_MAX 1024     // Буфер живых записей при сжатии (в стеке), байт
+#define NV_MAGIC       0x4E56u  // "NV"
+#define NV_DATA_MAX    255
+
+// Типы записей
+#define NV_TYPE_PID_BITMAP    0x01  // Поддерживаемые PID Mode 01, ключ - VIN и адрес ECU (или отпечаток ECU)
+#define NV_TYPE_VEHICLE       0x02  // OBD_Vehicle, ключ - хэш VIN
+#define NV_TYPE_LAST_VEHICLE  0x03  // Ключ последнего автомобиля, ключ записи 0
+
+/**
+  * @brief  CRC-32 (IEEE 802.3), crc = 0 для начала, результат можно продолжать.
+  */
+uint32_t NV_CRC32(uint32_t crc, const void *data, uint32_t len);
+
+/**
+  * @brief  Чтение последней записи type/key.
+  * @retval 1 - найдена запись длины len, 0 - нет
+  */
+uint8_t NV_Read(uint8_t type, uint32_t key, void *data, uint8_t len);
+
+/**
+  * @brief  Добавление записи. Совпадающая с последней запись не пишется повторно.
+  *         Сектор не стирается: места нет - запись пропускается до NV_Compact.
+  * @retval 1 - успешно, 0 - журнал полон или ошибка программирования flash
+  */
+uint8_t NV_Write(uint8_t type, uint32_t key, const void *data, uint8_t len);
+
+/**
+  * @brief  Сжатие журнала при старте, до включения USB и MCP2515: если
+  *         свободно меньше NV_RESERVE (или журнал испорчен), последние записи
+  *         каждого type/key копируются в RAM, сектор стирается и они пишутся
+  *         заново. Не влезшие в NV_COMPACT_MAX вытесняются начиная со старых.
+  * @retval 1 - успешно или сжатие не нужно, 0 - ошибка flash
+  */
+uint8_t NV_Compact(void);
+
+#endif /* __NVSTORE_H */
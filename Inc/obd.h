@@ -0,0 +1,163 @@
+#ifndef __OBD_H
+#define __OBD_H
+
+#include <stdint.h>
+#include "isotp.h"
+#include "obd_pid.h"
+#include "uds.h"
+
+/* Defines ------------------------------------------------------------------*/
+#define OBD_MAX_PIDS_PER_REQUEST  6   // ISO 15765-4: до 6 PID в одном запросе Mode 01
+#define OBD_TIMEOUT_MS            50  // P2 CAN
+#define OBD_PID_DATA_MAX          4   // Самый длинный ответ PID в таблице длин
+#define OBD_MAX_ECUS              8   // ISO 15765-4: до 8 ECU отвечают на функциональный запрос
+#define OBD_MISS_LIMIT            3   // Промахов подряд до отказа от PID или составных запросов
+
+// Адресация ECU двигателя (ISO 15765-4)
+#define OBD_ENGINE_ID_STD         0x7E8       // Ответ, 11 бит
+#define OBD_ENGINE_FC_STD         0x7E0       // Физический адрес для FC
+#define OBD_ENGINE_ID_EXT         0x18DAF110  // Ответ, 29 бит (ECU 0x10)
+#define OBD_ENGINE_FC_EXT         0x18DA10F1
+
+// ISO 27145-2 (WWH-OBD): данные OBD - DID сервиса 0x22
+#define OBD_WWH_DID_PID           0xF400      // 0xF4xx - PID xx Mode 01
+#define OBD_WWH_DID_INFO          0xF800      // 0xF8xx - InfoType xx Mode 09
+#define OBD_WWH_MAX_PIDS          UDS_RDBI_MAX_DIDS // Запрос [22 F4 xx ..] - одиночный кадр
+
+/**
+  * @brief  Значение одного PID из ответа Mode 01
+  */
+typedef struct {
+  uint8_t pid;
+  uint8_t valid;                   // 1 - PID пришел в ответе
+  uint8_t len;                     // Байт данных (A, B, ...)
+  uint8_t data[OBD_PID_DATA_MAX];
+} OBD_PID_Value;
+
+/**
+  * @brief  ECU, ответивший на функциональный запрос
+  */
+typedef struct {
+  uint32_t rx_id;                  // CAN ID ответов
+  uint8_t  ecu;                    // Для OBD_Init_Physical: номер 0..7 или адрес 29 бит
+  uint8_t  wwh;                    // 1 - ответил только на [22 F4 00] (ISO 27145)
+  uint8_t  supported[4];           // Ответ на PID 0x00
+} OBD_ECU_Info;
+
+/**
+  * @brief  Клиент OBD: канал ISO-TP к ECU двигателя и его особенности
+  */
+typedef struct {
+  ISOTP_Link link;
+  uint8_t    wwh;         // 1 - ISO 27145: PID Mode 01 читаются как DID 0xF4xx сервисом 0x22
+  uint8_t    multi_pid;   // 1 - ECU отвечает на несколько PID в одном запросе
+  uint8_t    multi_did;   // 1 - ECU отвечает на несколько DID в одном запросе 0x22
+  uint8_t    last_nrc;    // Код последнего отрицательного ответа (0 - не было)
+  uint8_t    unsupported[32]; // Битовая карта PID, на которые ECU не отвечает
+  uint8_t    misses[64];      // По 2 бита на PID: ответов подряд без этого PID
+  uint8_t    batch_misses;    // Составных ответов подряд с недостающими PID (отдельно пришли)
+  uint8_t    supported[32];   // Ответы PID 0x00, 0x20 .. 0xE0 подряд: бит 7 байта 0 - PID 0x01
+  uint8_t    supported_valid; // 1 - карта supported известна
+  uint32_t   vehicle_key;     // Ключ кэша карты: хэш VIN (0 - отпечаток по PID 0x00)
+  uint32_t   timeout_ms;
+} OBD_Client;
+
+/**
+  * @brief  Функциональные запросы (0x7DF / 0x18DB33F1), ответы ECU двигателя.
+  * @param  extended: 29-битная адресация (результат MCP2515_Auto_Detect)
+  */
+void OBD_Init(OBD_Client *obd, uint8_t extended);
+
+/**
+  * @brief  Физическая адресация одного ECU (ISO 15765-4).
+  * @param  ecu: 11 бит - номер ECU 0..7 (запрос 0x7E0+n, ответ 0x7E8+n),
+  *              29 бит - адрес ECU (запрос 0x18DAxxF1, ответ 0x18DAF1xx)
+  */
+void OBD_Init_Physical(OBD_Client *obd, uint8_t extended, uint8_t ecu);
+
+/**
+  * @brief  Сервис запросов PID: 0x01, для ISO 27145 - 0x22
+  */
+#define OBD_PID_SERVICE(obd)  ((obd)->wwh ? UDS_SID_RDBI : 0x01)
+
+/**
+  * @brief  Поиск ECU: функциональный запрос PID 0x00 (0x7DF / 0x18DB33F1)
+  *         и сбор всех ответов за окно P2 (OBD_TIMEOUT_MS), по одному на ECU.
+  *         На 29 битах без ответа - повтор запросом WWH-OBD [22 F4 00].
+  *         Дальше к каждому ECU - физическая адресация (OBD_Init_Physical):
+  *         отвечает только он, ответа не нужно ждать до конца окна.
+  * @param  ecus: Результат, по возрастанию CAN ID
+  * @retval Количество ответивших ECU
+  */
+uint8_t OBD_Enumerate_ECUs(uint8_t extended, OBD_ECU_Info *ecus, uint8_t max);
+
+/**
+  * @brief  PID Mode 01 можно запрашивать: есть в карте поддерживаемых
+  *         или карта неизвестна. PID 0x00 поддерживается всегда.
+  */
+uint8_t OBD_PID_Supported(const OBD_Client *obd, uint8_t pid);
+
+/**
+  * @brief  Сохранение ответа на PID диапазона (0x00, 0x20 .. 0xE0) в карту.
+  * @param  data: 4 байта ответа
+  * @retval PID следующего диапазона, если ECU сообщает о нем, иначе 0
+  */
+uint8_t OBD_Set_Supported(OBD_Client *obd, uint8_t range_pid, const uint8_t *data);
+
+/**
+  * @brief  Карта поддерживаемых PID из кэша во flash. Ключ - хэш VIN и адрес
+  *         ответа ECU (vehicle_key) или, без VIN, отпечаток ECU: адрес ответа
+  *         и ответ на PID 0x00 (должен быть уже в карте).
+  * @retval 1 - карта загружена, остальные диапазоны спрашивать не нужно
+  */
+uint8_t OBD_Cache_Load(OBD_Client *obd);
+
+/**
+  * @brief  Сохранение полной карты поддерживаемых PID в кэш.
+  */
+void OBD_Cache_Store(OBD_Client *obd);
+
+/**
+  * @brief  Опрос поддерживаемых PID (0x00, 0x20, ...) с ожиданием ответов.
+  *         Если ECU уже встречался (кэш), после PID 0x00 опрос заканчивается.
+  * @retval 1 - карта получена, 0 - ECU не ответил на PID 0x00
+  */
+uint8_t OBD_Discover_PIDs(OBD_Client *obd);
+
+/**
+  * @brief  Сколько PID можно объединить в одном запросе к ECU
+  */
+uint8_t OBD_PID_Batch(const OBD_Client *obd);
+
+/**
+  * @brief  Запрос PID: [01 PID ..] или для ISO 27145 [22 F4 PID ..].
+  * @param  req: Не меньше 1 + 2 * count байт
+  * @retval Длина запроса
+  */
+uint8_t OBD_Build_Request(const OBD_Client *obd, const uint8_t *pids, uint8_t count, uint8_t *req);
+
+/**
+  * @brief  Разбор положительного ответа на OBD_Build_Request
+  *         ([41 PID A B.. PID A..] или [62 F4 PID A.. F4 PID A..]) в values
+  *         (заполняются элементы, чей pid пришел в ответе).
+  * @retval Количество разобранных PID
+  */
+uint8_t OBD_Parse_Response(const OBD_Client *obd, const uint8_t *resp, uint16_t len,
+                           OBD_PID_Value *values, uint8_t count);
+
+/**
+  * @brief  Чтение нескольких PID Mode 01: по OBD_MAX_PIDS_PER_REQUEST в запросе,
+  *         составной ответ (обычно многокадровый) разбирается по таблице длин.
+  *         Если ECU отвергает составной запрос (NRC или нет ответа) или отвечает
+  *         только на часть PID, которые затем приходят по одному, клиент
+  *         переходит на запросы по одному PID. PID, не пришедшие от ECU,
+  *         который на связи, помечаются неподдерживаемыми и пропускаются,
+  *         как и PID, которых нет в карте поддерживаемых (OBD_Discover_PIDs).
+  * @param  pids: Запрашиваемые PID
+  * @param  count: Количество PID
+  * @param  values: Результат, по элементу на PID (в том же порядке)
+  * @retval Количество полученных значений
+  */
+uint8_t OBD_Read_PIDs(OBD_Client *obd, const uint8_t *pids, uint8_t count, OBD_PID_Value *values);
+
+#endif /* __OBD_H */
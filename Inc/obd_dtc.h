@@ -0,0 +1,63 @@
+#ifndef __OBD_DTC_H
+#define __OBD_DTC_H
+
+#include <stdint.h>
+#include "obd_sched.h"
+
+/* Defines ------------------------------------------------------------------*/
+#define OBD_DTC_MAX        32    // Кодов в хранилище одного ECU
+
+// Откуда известен код (биты OBD_DTC.kinds)
+#define OBD_DTC_STORED     0x01  // Mode 03 - подтвержденные
+#define OBD_DTC_PENDING    0x02  // Mode 07 - ожидающие подтверждения
+#define OBD_DTC_PERMANENT  0x04  // Mode 0A - постоянные
+
+/**
+  * @brief  Код неисправности: 2 байта как в ответе (биты 15-14 - P/C/B/U)
+  */
+typedef struct {
+  uint16_t code;
+  uint8_t  kinds;
+} OBD_DTC;
+
+/**
+  * @brief  Коды одного ECU без повторов и статус из PID 0x01.
+  *         Списки Mode 03/07/0A запрашиваются только при смене MIL или
+  *         количества DTC, а не на каждом опросе статуса.
+  */
+typedef struct {
+  OBD_DTC     dtc[OBD_DTC_MAX];
+  uint8_t     count;
+  uint8_t     overflow;      // Кодов пришло больше OBD_DTC_MAX
+  uint8_t     status_valid;  // mil и reported получены
+  uint8_t     mil;           // Последний статус MIL из PID 0x01
+  uint8_t     reported;      // Количество DTC из PID 0x01
+  uint8_t     changes;       // Счетчик разобранных списков (для перерисовки)
+  OBD_Signal *fetch[3];      // Сигналы Mode 03, 07, 0A в таблице планировщика (NULL - нет)
+} OBD_DTC_Store;
+
+/**
+  * @brief  Текстовый вид кода: "P0301".
+  * @param  out: Не меньше 6 байт
+  */
+void OBD_DTC_Format(uint16_t code, char *out);
+
+/**
+  * @brief  Разбор ответа Mode 03/07/0A (после SID): [N] [DTC, 2] ...
+  *         Коды этого вида, которых больше нет в ответе, удаляются.
+  * @retval Кодов в ответе
+  */
+uint8_t OBD_DTC_Parse(OBD_DTC_Store *store, uint8_t service, const uint8_t *data, uint16_t len);
+
+/**
+  * @brief  on_update для сигналов Mode 03/07/0A (context - OBD_DTC_Store).
+  */
+void OBD_DTC_On_List(const OBD_Signal *sig);
+
+/**
+  * @brief  on_update для сигнала Mode 01 PID 0x01 (context - OBD_DTC_Store):
+  *         при смене MIL или количества DTC запрашивает списки заново.
+  */
+void OBD_DTC_On_Status(const OBD_Signal *sig);
+
+#endif /* __OBD_DTC_H */
@@ -0,0 +1,94 @@
+#ifndef __OBD_PID_H
+#define __OBD_PID_H
+
+#include <stdint.h>
+
+/* Defines ------------------------------------------------------------------*/
+#define OBD_PID_SIGNED  0x01  // Поле в дополнительном коде
+
+/**
+  * @brief  Единицы измерения значения поля
+  */
+typedef enum {
+  OBD_UNIT_NONE = 0,  // Битовое поле, перечисление
+  OBD_UNIT_COUNT,
+  OBD_UNIT_PERCENT,
+  OBD_UNIT_DEG_C,
+  OBD_UNIT_KPA,
+  OBD_UNIT_PA,
+  OBD_UNIT_RPM,
+  OBD_UNIT_KMH,
+  OBD_UNIT_DEG,       // Угол, градусы
+  OBD_UNIT_GS,        // Массовый расход воздуха, г/с
+  OBD_UNIT_V,
+  OBD_UNIT_MA,
+  OBD_UNIT_RATIO,     // Коэффициент избытка воздуха (лямбда)
+  OBD_UNIT_S,
+  OBD_UNIT_MIN,
+  OBD_UNIT_KM,
+  OBD_UNIT_LH,        // Расход топлива, л/ч
+  OBD_UNIT_NM,
+  OBD_UNIT_DTC,       // Код неисправности, 2 байта
+} OBD_Unit;
+
+/**
+  * @brief  Поле PID Mode 01 (SAE J1979): где лежит и как масштабируется.
+  *         Значение = (raw * num / den + offset) / 10^decimals единиц unit,
+  *         raw - bits бит начиная с бита shift числа из bytes байт (big-endian)
+  *         от байта pos (0 - A). Все коэффициенты целые: без плавающей точки.
+  */
+typedef struct {
+  uint8_t     pid;
+  uint8_t     pos;
+  uint8_t     bytes;
+  uint8_t     shift;
+  uint8_t     bits;
+  uint8_t     flags;      // OBD_PID_SIGNED
+  uint8_t     unit;       // OBD_Unit
+  uint8_t     decimals;
+  int32_t     num;
+  int32_t     den;
+  int32_t     offset;     // В единицах результата (с учетом decimals)
+  const char *name;
+} OBD_PID_Field;
+
+/**
+  * @brief  Длина данных PID Mode 01 по SAE J1979.
+  * @retval Байт данных, 0 - PID неизвестен (разобрать ответ за ним нельзя)
+  */
+uint8_t OBD_PID_Length(uint8_t pid);
+
+/**
+  * @brief  Поля PID в таблице.
+  * @param  count: Количество полей (0 - PID не описан)
+  * @retval Первое поле
+  */
+const OBD_PID_Field *OBD_PID_Fields(uint8_t pid, uint8_t *count);
+
+/**
+  * @brief  Масштабированное целое значение поля из данных PID (A, B, ...).
+  *         Данные должны содержать не меньше OBD_PID_Length(pid) байт.
+  */
+int32_t OBD_PID_Decode(const OBD_PID_Field *field, const uint8_t *data);
+
+/**
+  * @brief  Поле index PID pid из ответа длины len.
+  * @retval 1 - значение в *value, 0 - поля нет или данных мало
+  */
+uint8_t OBD_PID_Get(uint8_t pid, uint8_t index, const uint8_t *data, uint8_t len, int32_t *value);
+
+/**
+  * @brief  Обозначение единицы измерения для вывода
+  */
+const char *OBD_Unit_Name(uint8_t unit);
+
+#ifdef DEBUG
+/**
+  * @brief  Сверка таблицы с Parse_Engine_RPM, Parse_Coolant_Temperature
+  *         и Parse_DTC_Status на всех значениях байтов.
+  * @retval Количество расхождений
+  */
+uint32_t OBD_PID_Self_Test(void);
+#endif
+
+#endif /* __OBD_PID_H */
@@ -0,0 +1,192 @@
+#ifndef __OBD_SCHED_H
+#define __OBD_SCHED_H
+
+#include <stdint.h>
+#include "obd.h"
+#include "uds.h"
+#include "can_dispatch.h"
+
+/* Defines ------------------------------------------------------------------*/
+#define OBD_SCHED_MAX_ECUS  4     // Каналов ISO-TP (по ~1 КБ RAM на канал)
+#define OBD_SCHED_RETRIES   2     // Повторов запроса по таймауту
+#define OBD_NRC_STATS       8     // Пар сервис/NRC в статистике ECU
+#define OBD_BACKOFF_MAX_MS  10000 // Предел растяжения периода при ошибках
+#define OBD_DISCOVER_RETRY_MS 1000 // Пауза перед новым опросом молчащего ECU
+
+// Адаптивный таймаут ответа (как adaptive timing ELM327)
+#define OBD_LAT_BINS        16    // Корзин гистограммы задержки ответа
+#define OBD_LAT_WINDOW      128   // Выборок в гистограмме: дальше старые счетчики делятся пополам
+#define OBD_LAT_MIN_SAMPLES 16    // Меньше выборок - таймаут полный (client.timeout_ms)
+#define OBD_LAT_PERCENTILE  98    // Таймаут - верхняя граница корзины этого процентиля
+#define OBD_LAT_MARGIN_MS   2     // Запас: дискретность HAL_GetTick() и дрожание ответа
+
+/**
+  * @brief  Состояние сигнала
+  */
+typedef enum {
+  OBD_SIG_NONE = 0,     // Значения еще не было
+  OBD_SIG_VALID,        // Значение получено
+  OBD_SIG_ERROR,        // Нет ответа после повторов или NRC
+  OBD_SIG_UNSUPPORTED,  // ECU на связи, но PID не отдает - больше не запрашивается
+} OBD_Signal_State;
+
+/**
+  * @brief  Скользящая гистограмма задержки запрос->ответ и таймаут по ней.
+  *         Пропущенный ответ учитывается как ответ на полном таймауте:
+  *         если ECU начал отвечать медленнее, таймаут сам вернется к полному.
+  *         По выученному таймауту запрос сразу повторяется (после
+  *         OBD_SCHED_RETRIES - очередь следующих сигналов), опоздавший ответ
+  *         с другими PID/DID отбрасывается.
+  */
+typedef struct {
+  uint16_t bins[OBD_LAT_BINS]; // Границы корзин - OBD_Latency_Bin_Max
+  uint16_t total;
+  uint16_t timeout_ms;   // Выученный таймаут, 0 - выборок мало
+} OBD_Latency;
+
+struct OBD_Signal;
+typedef void (*OBD_Signal_Callback)(const struct OBD_Signal *sig);
+
+/**
+  * @brief  Строка таблицы сигналов: что, у кого и как часто запрашивать,
+  *         и последнее полученное значение.
+  */
+typedef struct OBD_Signal {
+  // Описание (заполняет приложение)
+  uint8_t  ecu;          // Индекс ECU (OBD_Sched_Add_ECU)
+  uint8_t  service;      // 0x01 - запросы объединяются до 6 PID; 0x03, 0x07, 0x0A - без PID;
+                         // 0x22 (UDS) - до UDS_RDBI_MAX_DIDS DID
+  uint8_t  pid;
+  uint16_t did;          // 0x22: идентификатор данных
+  uint8_t  did_len;      // 0x22: длина данных DID, 0 - неизвестна (запрос одиночный)
+  uint16_t period_ms;    // Желаемый период обновления, 0 - однократно (и по OBD_Sched_Request)
+  OBD_Signal_Callback on_update; // Вызывается при новом значении или ошибке (может быть NULL)
+  void    *context;      // Данные приложения для on_update
+
+  // Состояние (заполняет планировщик)
+  OBD_Signal_State state;
+  uint8_t  pending;      // Запрос в полете
+  uint8_t  solo;         // Не пришел в составном ответе - следующий запрос одиночный
+  uint8_t  nrc;          // Последний отрицательный ответ
+  uint8_t  len;
+  uint8_t  data[OBD_PID_DATA_MAX];
+  const uint8_t *payload; // Весь ответ после SID (и PID) - только внутри on_update
+  uint16_t payload_len;
+  uint8_t  request;      // Запрос вне периода (OBD_Sched_Request)
+  uint32_t due;          // HAL_GetTick() следующего запроса (крайний срок для EDF)
+  uint32_t updated;      // HAL_GetTick() последнего значения
+  uint16_t interval_ms;  // Фактический период планирования: period_ms, растянутый
+                         // до времени ответа ECU или при ошибках
+  uint16_t achieved_ms;  // Достигнутый период обновления (скользящее среднее)
+  uint32_t updates;      // Получено значений
+  OBD_Latency latency;   // Задержка ответа ECU на этот PID/DID
+} OBD_Signal;
+
+/**
+  * @brief  Сколько раз ECU ответил на сервис sid отрицательным ответом nrc
+  */
+typedef struct {
+  uint8_t  sid;
+  uint8_t  nrc;
+  uint16_t count;        // Насыщается на 0xFFFF
+} OBD_NRC_Stat;
+
+/**
+  * @brief  ECU и запрос, ожидающий ответа
+  */
+typedef struct {
+  OBD_Client client;
+  uint8_t  busy;         // Запрос отправлен, ждем ответа
+  uint8_t  service;
+  uint8_t  count;        // Сигналов в запросе
+  uint8_t  sig[OBD_MAX_PIDS_PER_REQUEST]; // Индексы сигналов в запросе
+  uint8_t  retries;
+  uint8_t  discovering;  // Опрос поддерживаемых PID, сигналы ждут
+  uint8_t  disc_pid;     // Запрашиваемый PID диапазона (0x00, 0x20, ...)
+  uint8_t  control;      // Служебный запрос в полете (опрос PID, смена сессии)
+  uint8_t  session;      // Нужная сессия UDS (OBD_Sched_Set_Session)
+  uint8_t  session_active; // Сессия, подтвержденная ECU
+  uint32_t p2_star_ms;   // Ожидание после NRC 0x78 (из ответа DSC)
+  uint32_t tester_tick;  // HAL_GetTick() последнего запроса к ECU (для TesterPresent)
+  uint32_t deadline;     // HAL_GetTick() окончания ожидания ответа (при опросе PID
+                         // молчащего ECU - паузы до следующей попытки)
+  uint32_t sent;         // HAL_GetTick() отправки запроса
+  uint16_t rtt_ms;       // Время ответа ECU (скользящее среднее)
+  OBD_Latency latency;   // Задержка ответа на все запросы ECU (и служебные)
+  OBD_NRC_Stat nrc_stats[OBD_NRC_STATS]; // Отрицательные ответы (и 0x78) по сервисам
+  uint8_t  nrc_count;
+  uint16_t nrc_lost;     // Не поместились в nrc_stats
+} OBD_Sched_ECU;
+
+/**
+  * @brief  Планировщик: по одному запросу в полете на каждый ECU,
+  *         ECU опрашиваются параллельно. Очередной запрос - сигналу с самым
+  *         ранним крайним сроком (EDF), в составной запрос Mode 01 добавляются
+  *         остальные просроченные сигналы в порядке сроков.
+  */
+typedef struct {
+  OBD_Sched_ECU ecu[OBD_SCHED_MAX_ECUS];
+  uint8_t       ecu_count;
+  OBD_Signal   *signals;
+  uint8_t       signal_count;
+  void (*frame_hook)(const CAN_Frame *frame); // Кадры вне каналов ECU (может быть NULL)
+  uint8_t       isotp_ecu[CAN_DISPATCH_ISOTP_IDS]; // 11 бит: номер ECU + 1 по слоту ISO-TP таблицы разбора
+  uint8_t       std_scan;    // 11-битный ECU вне таблицы разбора - перебор каналов
+  uint32_t      vehicle_key; // Хэш VIN (OBD_Vehicle_Key) до OBD_Sched_Add_ECU: карты PID из кэша
+} OBD_Sched;
+
+/**
+  * @brief  Подключение таблицы сигналов. Все сигналы запрашиваются сразу.
+  */
+void OBD_Sched_Init(OBD_Sched *sched, OBD_Signal *signals, uint8_t count);
+
+/**
+  * @brief  Добавление ECU с физической адресацией (см. OBD_Init_Physical).
+  *         Сначала опрашиваются поддерживаемые PID (с кэшем во flash;
+  *         известному по VIN автомобилю опрос не нужен), сигналы Mode 01
+  *         вне карты не запрашиваются вовсе.
+  * @retval Индекс ECU для OBD_Signal.ecu, 0xFF - нет места
+  */
+uint8_t OBD_Sched_Add_ECU(OBD_Sched *sched, uint8_t extended, uint8_t ecu);
+
+/**
+  * @brief  Добавление ECU, найденного OBD_Enumerate_ECUs: ответ на PID 0x00
+  *         уже получен, опрос поддерживаемых PID начинается с 0x20 (или
+  *         не нужен вовсе, если карта этого ECU есть в кэше).
+  * @retval Индекс ECU для OBD_Signal.ecu, 0xFF - нет места
+  */
+uint8_t OBD_Sched_Add_Found(OBD_Sched *sched, uint8_t extended, const OBD_ECU_Info *info);
+
+/**
+  * @brief  Один проход без ожидания: разбор принятых кадров, ISO-TP,
+  *         ответы и таймауты, отправка новых запросов.
+  *         Вызывать в основном цикле вместе с остальными задачами.
+  */
+void OBD_Sched_Task(OBD_Sched *sched);
+
+/**
+  * @brief  Смена сессии UDS (DiagnosticSessionControl) до следующих запросов
+  *         к ECU. Вне сессии по умолчанию планировщик сам шлет TesterPresent
+  *         (без ответа) каждые UDS_TESTER_PRESENT_MS, если ECU простаивает,
+  *         а после NRC 0x7E/0x7F (сессия сброшена ECU) входит в нее заново.
+  */
+void OBD_Sched_Set_Session(OBD_Sched *sched, uint8_t ecu, uint8_t session);
+
+/**
+  * @brief  Запросить сигнал при первой возможности, в том числе однократный.
+  */
+void OBD_Sched_Request(OBD_Signal *sig);
+
+/**
+  * @brief  Верхняя граница корзины гистограммы задержки, мс
+  *         (последняя корзина - все, что дольше предпоследней).
+  */
+uint16_t OBD_Latency_Bin_Max(uint8_t bin);
+
+/**
+  * @brief  Достигнутая частота обновления сигнала, десятые доли Гц
+  *         (для сравнения с желаемой 10000 / period_ms).
+  */
+uint16_t OBD_Signal_Rate_x10(const OBD_Signal *sig);
+
+#endif /* __OBD_SCHED_H */
@@ -0,0 +1,61 @@
+#ifndef __OBD_VEHICLE_H
+#define __OBD_VEHICLE_H
+
+#include <stdint.h>
+#include "obd.h"
+
+/* Defines ------------------------------------------------------------------*/
+#define OBD_VIN_LEN       17
+#define OBD_CALID_LEN     16
+#define OBD_CALID_MAX     4     // CALID/CVN в записи (обычно 1-2 на ECU двигателя)
+
+/**
+  * @brief  Автомобиль: Mode 09 и все, что о нем узнали при подключении.
+  *         Хранится во flash (nvstore) с ключом - хэшем VIN.
+  */
+typedef struct {
+  char         vin[OBD_VIN_LEN + 1];                  // "" - VIN не прочитан
+  uint8_t      calid_count;
+  char         calid[OBD_CALID_MAX][OBD_CALID_LEN + 1];
+  uint8_t      cvn_count;
+  uint32_t     cvn[OBD_CALID_MAX];
+  uint32_t     bitrate;
+  uint8_t      extended;                              // 29-битная адресация
+  uint8_t      ecu_count;
+  OBD_ECU_Info ecus[OBD_MAX_ECUS];                    // ECU двигателя первым (если ответил)
+} OBD_Vehicle;
+
+/**
+  * @brief  Mode 09 PID 0x02: VIN (многокадровый ответ).
+  * @param  vin: Не меньше OBD_VIN_LEN + 1 байт
+  * @retval 1 - прочитан
+  */
+uint8_t OBD_Read_VIN(OBD_Client *obd, char *vin);
+
+/**
+  * @brief  Mode 09: VIN, CALID (PID 0x04) и CVN (PID 0x06).
+  *         CALID и CVN необязательны - без них остаются пустыми.
+  * @retval 1 - VIN прочитан
+  */
+uint8_t OBD_Read_Vehicle(OBD_Client *obd, OBD_Vehicle *veh);
+
+/**
+  * @brief  Ключ кэша автомобиля (хэш VIN), 0 - VIN неизвестен.
+  */
+uint32_t OBD_Vehicle_Key(const OBD_Vehicle *veh);
+
+/**
+  * @brief  Сохранение записи автомобиля, он же - последний подключенный.
+  */
+void OBD_Vehicle_Save(const OBD_Vehicle *veh);
+
+/**
+  * @brief  Подключение к шине. Если последний автомобиль отвечает на старой
+  *         скорости тем же VIN - конфигурация из flash, один запрос вместо
+  *         определения скорости, поиска ECU и опроса PID. Иначе полный
+  *         цикл: MCP2515_Init_Auto, OBD_Enumerate_ECUs, Mode 09 и сохранение.
+  * @retval 1 - конфигурация восстановлена, 0 - получена заново
+  */
+uint8_t OBD_Vehicle_Connect(OBD_Vehicle *veh);
+
+#endif /* __OBD_VEHICLE_H */
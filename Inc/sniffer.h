@@ -0,0 +1,50 @@
+#ifndef __SNIFFER_H
+#define __SNIFFER_H
+
+#include <stdint.h>
+
+/* Defines ------------------------------------------------------------------*/
+/*
+  * Двоичный поток в USB CDC, все многобайтные поля little-endian.
+  * Каждая запись начинается с SNIFFER_SYNC, затем байт типа/флагов.
+  *
+  * Кадр (8-18 байт):
+  *   [0xA5] [flags] [timestamp, 4] [id, 2 или 4] [data, dlc]
+  *   flags: биты 3-0 - DLC, SNIFFER_FLAG_EXT - 29-битный ID (4 байта),
+  *          SNIFFER_FLAG_RTR - удаленный запрос (байтов data нет),
+  *          биты 7-6 = 0 (тип "кадр")
+  *
+  * Статистика (28 байт, раз в SNIFFER_STATS_PERIOD_MS):
+  *   [0xA5] [0x40] [timestamp, 4] [rx_frames, 4] [ring_drops, 4]
+  *   [hw_overflows, 4] [bus_errors, 4] [stream_drops, 4] [bitrate/1000, 2]
+  *
+  * timestamp - micros() в момент обработки INT, переполняется через ~71 мин.
+  */
+#define SNIFFER_SYNC             0xA5
+#define SNIFFER_FLAG_EXT         0x10
+#define SNIFFER_FLAG_RTR         0x20
+#define SNIFFER_TYPE_FRAME       0x00
+#define SNIFFER_TYPE_STATS       0x40
+#define SNIFFER_TYPE_MASK        0xC0
+
+#define SNIFFER_RECORD_MAX       28    // Самая длинная запись (статистика)
+#define SNIFFER_STATS_PERIOD_MS  1000
+
+/**
+  * @brief  Перевод MCP2515 в пассивный прием всех кадров на заданной скорости.
+  * @retval 1 - успешно, 0 - скорость недостижима с этим кварцем
+  */
+uint8_t Sniffer_Start(uint32_t bitrate);
+
+/**
+  * @brief  Перекладывает принятые кадры в поток USB, периодически
+  *         добавляет запись статистики. Вызывать в основном цикле.
+  */
+void Sniffer_Task(void);
+
+/**
+  * @brief  Режим сниффера вместо основного цикла (не возвращается).
+  */
+void Sniffer_Run(uint32_t bitrate);
+
+#endif /* __SNIFFER_H */
@@ -0,0 +1,86 @@
+#ifndef __UDS_H
+#define __UDS_H
+
+#include <stdint.h>
+
+/* Defines ------------------------------------------------------------------*/
+// Сервисы ISO 14229-1
+#define UDS_SID_DSC              0x10  // DiagnosticSessionControl
+#define UDS_SID_RDBI             0x22  // ReadDataByIdentifier
+#define UDS_SID_TESTER_PRESENT   0x3E
+#define UDS_SID_NEGATIVE         0x7F  // Отрицательный ответ [7F SID NRC]
+#define UDS_POSITIVE(sid)        ((uint8_t)((sid) + 0x40))
+#define UDS_SUPPRESS_RESPONSE    0x80  // suppressPosRspMsgIndicationBit подфункции
+
+// Сессии
+#define UDS_SESSION_DEFAULT      0x01
+#define UDS_SESSION_PROGRAMMING  0x02
+#define UDS_SESSION_EXTENDED     0x03
+
+// Коды отрицательных ответов (NRC)
+#define UDS_NRC_GENERAL_REJECT           0x10
+#define UDS_NRC_SERVICE_NOT_SUPPORTED    0x11
+#define UDS_NRC_SUBFUNC_NOT_SUPPORTED    0x12
+#define UDS_NRC_INCORRECT_LENGTH         0x13
+#define UDS_NRC_RESPONSE_TOO_LONG        0x14
+#define UDS_NRC_BUSY_REPEAT              0x21
+#define UDS_NRC_CONDITIONS_NOT_CORRECT   0x22
+#define UDS_NRC_OUT_OF_RANGE             0x31
+#define UDS_NRC_SECURITY_DENIED          0x33
+#define UDS_NRC_RESPONSE_PENDING         0x78
+#define UDS_NRC_SUBFUNC_NOT_IN_SESSION   0x7E
+#define UDS_NRC_SERVICE_NOT_IN_SESSION   0x7F
+
+// Тайминги (ISO 14229-2)
+#define UDS_S3_SERVER_MS         5000  // ECU возвращается в сессию по умолчанию без запросов
+#define UDS_TESTER_PRESENT_MS    2000  // Период TesterPresent вне сессии по умолчанию
+#define UDS_P2_STAR_UNIT_MS      10    // P2* в ответе DSC - в единицах 10 мс
+#define UDS_P2_STAR_MS           5000  // P2*server_max по умолчанию: ожидание после NRC 0x78
+
+// Запрос 0x22 из 3 DID - 7 байт, одиночный кадр: без FF/FC на каждый опрос
+#define UDS_RDBI_MAX_DIDS        3
+
+/**
+  * @brief  Что делать с ответом на запрос сервиса sid
+  */
+typedef enum {
+  UDS_RESP_FOREIGN = 0,   // Не ответ на запрос (другой SID) - ждать дальше
+  UDS_RESP_POSITIVE,
+  UDS_RESP_PENDING,       // NRC 0x78: ответ будет позже, ждать P2*
+  UDS_RESP_UNSUPPORTED,   // Повторять бесполезно: нет сервиса, DID, доступа
+  UDS_RESP_SESSION,       // NRC 0x7E/0x7F: ECU не в нужной сессии
+  UDS_RESP_RETRY,         // Отказ сейчас (занят, условия) - позже с увеличенным периодом
+} UDS_Resp_Class;
+
+/**
+  * @brief  Классификация ответа [sid+0x40 ..] / [7F sid NRC].
+  *         NRC отрицательного ответа - resp[2].
+  */
+UDS_Resp_Class UDS_Classify(const uint8_t *resp, uint16_t len, uint8_t sid);
+
+/**
+  * @brief  Название NRC для диагностического вывода
+  */
+const char *UDS_NRC_Name(uint8_t nrc);
+
+/**
+  * @brief  Разбор ответа ReadDataByIdentifier [62 DID data DID data ...].
+  *         DID ищутся по номеру, длины данных - из lens (0 - данные до конца
+  *         ответа, только у последнего DID).
+  * @param  offsets: Смещение данных DID в resp (0 - DID не пришел)
+  * @param  sizes: Длина данных DID
+  * @retval Количество разобранных DID
+  */
+uint8_t UDS_Parse_RDBI(const uint8_t *resp, uint16_t len, const uint16_t *dids, const uint8_t *lens,
+                       uint8_t count, uint16_t *offsets, uint16_t *sizes);
+
+/**
+  * @brief  Разбор ответа DiagnosticSessionControl [50 session P2 P2*].
+  * @param  p2_ms: P2server_max, мс
+  * @param  p2_star_ms: P2*server_max, мс
+  * @retval 1 - ответ на сессию session
+  */
+uint8_t UDS_Parse_DSC(const uint8_t *resp, uint16_t len, uint8_t session,
+                      uint16_t *p2_ms, uint32_t *p2_star_ms);
+
+#endif /* __UDS_H */
@@ -51,6 +51,8 @@
 #define APP_RX_DATA_SIZE  1024
 #define APP_TX_DATA_SIZE  1024
 /* USER CODE BEGIN EXPORTED_DEFINES */
+// Кольцо потоковой передачи (степень двойки, делитель 65536)
+#define CDC_STREAM_SIZE  4096
 
 /* USER CODE END EXPORTED_DEFINES */
 
@@ -108,6 +110,9 @@ extern USBD_CDC_ItfTypeDef USBD_Interface_fops_FS;
 uint8_t CDC_Transmit_FS(uint8_t* Buf, uint16_t Len);
 
 /* USER CODE BEGIN EXPORTED_FUNCTIONS */
+uint16_t CDC_Stream_Write(const uint8_t* Buf, uint16_t Len);
+void CDC_Stream_Flush(void);
+uint32_t CDC_Stream_Drops(void);
 
 /* USER CODE END EXPORTED_FUNCTIONS */
 
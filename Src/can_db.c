@@ -0,0 +1,109 @@
+#include "main.h"
+#include "can_db.h"
+#include "can_dispatch.h"
+#include <string.h>
+
+CAN_DB_Value can_db_values[CAN_DB_SIGNAL_COUNT];
+
+static const int32_t dec_scale[] = {1, 10, 100, 1000, 10000, 100000};
+
+const CAN_DB_Message *CAN_DB_Find(uint32_t id, uint8_t extended)
+{
+  uint32_t key = id | CAN_DB_EXTENDED;
+  uint16_t lo = 0, hi = CAN_DB_MESSAGE_COUNT;
+
+  if (!extended) {
+    uint16_t slot = CAN_Dispatch_Std(id);
+    return CAN_DISPATCH_HANDLER(slot) == CAN_DISPATCH_DB ? &can_db_messages[CAN_DISPATCH_ARG(slot)] : NULL;
+  }
+
+  while (lo < hi) {
+    uint16_t mid = (lo + hi) / 2;
+    if (can_db_messages[mid].id == key) return &can_db_messages[mid];
+    if (can_db_messages[mid].id < key) lo = mid + 1;
+    else hi = mid;
+  }
+  return NULL;
+}
+
+/**
+  * @brief  Сигнал из готовых слов кадра: сдвиг, маска, знак, масштаб
+  */
+static int32_t CAN_DB_Extract(const CAN_DB_Signal *sig, uint64_t intel, uint64_t motorola)
+{
+  uint32_t raw = (uint32_t)(((sig->flags & CAN_DB_MOTOROLA) ? motorola : intel) >> sig->shift) & sig->mask;
+
+  if ((sig->flags & CAN_DB_SIGNED) && (raw & ~(sig->mask >> 1))) raw |= ~sig->mask; // Расширение знака
+  // Целиком в int32 (SDIV, без __aeabi_ldivmod): переполнение исключает Tools/dbc2c.py
+  return (int32_t)raw * sig->num / sig->den + sig->offset;
+}
+
+/**
+  * @brief  8 байт данных кадра как слово Intel (data[0] младший) и Motorola (data[0] старший)
+  */
+static void CAN_DB_Words(const CAN_Frame *frame, uint64_t *intel, uint64_t *motorola)
+{
+  memcpy(intel, frame->data, sizeof(*intel)); // Cortex-M little-endian
+  *motorola = __builtin_bswap64(*intel);      // REV + REV
+}
+
+uint8_t CAN_DB_Decode(const CAN_DB_Signal *sig, const CAN_Frame *frame, int32_t *value)
+{
+  uint64_t intel, motorola;
+
+  if (frame->dlc < sig->dlc) return 0;
+  CAN_DB_Words(frame, &intel, &motorola);
+  *value = CAN_DB_Extract(sig, intel, motorola);
+  return 1;
+}
+
+uint8_t CAN_DB_On_Frame(const CAN_Frame *frame)
+{
+  const CAN_DB_Message *msg;
+  uint64_t intel, motorola;
+
+  if (frame->rtr || !(msg = CAN_DB_Find(frame->id, frame->extended))) return 0;
+
+  uint32_t now = HAL_GetTick();
+  CAN_DB_Words(frame, &intel, &motorola);
+  for (uint16_t i = msg->first; i < msg->first + msg->count; i++) {
+    if (frame->dlc < can_db_signals[i].dlc) continue;
+    can_db_values[i].value = CAN_DB_Extract(&can_db_signals[i], intel, motorola);
+    can_db_values[i].valid = 1;
+    can_db_values[i].updated = now;
+    can_db_values[i].updates++;
+  }
+  return 1;
+}
+
+uint8_t CAN_DB_Get(uint16_t index, uint8_t decimals, uint32_t max_age_ms, int32_t *value)
+{
+  if (index >= CAN_DB_SIGNAL_COUNT) return 0;
+  const CAN_DB_Value *v = &can_db_values[index];
+  uint8_t have = can_db_signals[index].decimals;
+
+  if (!v->valid || HAL_GetTick() - v->updated > max_age_ms) return 0;
+  if (decimals >= have) *value = v->value * dec_scale[decimals - have];
+  else *value = v->value / dec_scale[have - decimals];
+  return 1;
+}
+
+uint8_t CAN_DB_Filter_Ranges(CAN_Filter_Range *ranges, uint8_t max)
+{
+  uint8_t count = 0;
+
+  for (uint16_t i = 0; i < CAN_DB_MESSAGE_COUNT; i++) {
+    uint8_t extended = (can_db_messages[i].id & CAN_DB_EXTENDED) != 0;
+    uint32_t id = can_db_messages[i].id & ~CAN_DB_EXTENDED;
+
+    // Таблица по возрастанию: соседний ID продолжает предыдущий диапазон
+    if (count && ranges[count - 1].extended == extended && ranges[count - 1].id_to + 1 == id) {
+      ranges[count - 1].id_to = id;
+      continue;
+    }
+    if (count >= max) break;
+    ranges[count].id_from = ranges[count].id_to = id;
+    ranges[count++].extended = extended;
+  }
+  return count;
+}
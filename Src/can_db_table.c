@@ -0,0 +1,22 @@
+/* Сгенерировано Tools/dbc2c.py из example.dbc - не править вручную */
+#include "can_db.h"
+
+const CAN_DB_Message can_db_messages[CAN_DB_MESSAGE_COUNT] = {
+  { 0x00000201,   0, 3 },  // ECM_Engine1, 11 бит
+  { 0x00000420,   3, 3 },  // ECM_Engine2, 11 бит
+  { 0x000004B0,   6, 2 },  // ABS_Wheels, 11 бит
+  { 0x8CF004FE,   8, 1 },  // EEC1, 29 бит
+};
+
+const CAN_DB_Signal can_db_signals[CAN_DB_SIGNAL_COUNT] = {
+  // shift, bits, flags, dlc, mask, unit, decimals, num, den, offset, name
+  { 48, 16, CAN_DB_MOTOROLA, 2, 0x0000FFFF, OBD_UNIT_RPM, 2, 25, 1, 0, "EngineSpeed" },
+  { 40,  8, CAN_DB_MOTOROLA, 3, 0x000000FF, OBD_UNIT_PERCENT, 1, 4, 1, 0, "ThrottlePosition" },
+  { 28, 12, CAN_DB_MOTOROLA | CAN_DB_SIGNED, 5, 0x00000FFF, OBD_UNIT_NM, 1, 5, 1, 0, "EngineTorque" },
+  {  0,  8, 0, 1, 0x000000FF, OBD_UNIT_DEG_C, 0, 1, 1, -40, "CoolantTemp" },
+  {  8,  8, 0, 2, 0x000000FF, OBD_UNIT_DEG_C, 0, 1, 1, -40, "OilTemp" },
+  { 16,  8, 0, 3, 0x000000FF, OBD_UNIT_V, 1, 1, 1, 0, "BatteryVoltage" },
+  {  0, 16, 0, 2, 0x0000FFFF, OBD_UNIT_KMH, 2, 1, 1, 0, "VehicleSpeed" },
+  { 16, 16, CAN_DB_SIGNED, 4, 0x0000FFFF, OBD_UNIT_DEG, 1, 1, 1, 0, "SteeringAngle" },
+  { 24, 16, 0, 5, 0x0000FFFF, OBD_UNIT_RPM, 3, 125, 1, 0, "EngineSpeedJ1939" },
+};
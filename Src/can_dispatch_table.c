@@ -0,0 +1,42 @@
+/* Сгенерировано Tools/dbc2c.py из example.dbc - не править вручную */
+#include "can_dispatch.h"
+
+// Бит (id & 31) слова id >> 5 - ID в таблице
+const uint32_t can_dispatch_bitmap[64] = {
+  0x00000000, 0x00000000, 0x00000000, 0x00000000, 0x00000000, 0x00000000, 0x00000000, 0x00000000,
+  0x00000000, 0x00000000, 0x00000000, 0x00000000, 0x00000000, 0x00000000, 0x00000000, 0x00000000,
+  0x00000002, 0x00000000, 0x00000000, 0x00000000, 0x00000000, 0x00000000, 0x00000000, 0x00000000,
+  0x00000000, 0x00000000, 0x00000000, 0x00000000, 0x00000000, 0x00000000, 0x00000000, 0x00000000,
+  0x00000000, 0x00000001, 0x00000000, 0x00000000, 0x00000000, 0x00010000, 0x00000000, 0x00000000,
+  0x00000000, 0x00000000, 0x00000000, 0x00000000, 0x00000000, 0x00000000, 0x00000000, 0x00000000,
+  0x00000000, 0x00000000, 0x00000000, 0x00000000, 0x00000000, 0x00000000, 0x00000000, 0x00000000,
+  0x00000000, 0x00000000, 0x00000000, 0x00000000, 0x00000000, 0x00000000, 0x00000000, 0x0000FF00,
+};
+
+// Единиц карты в словах до данного
+const uint16_t can_dispatch_rank[64] = {
+     0,    0,    0,    0,    0,    0,    0,    0,
+     0,    0,    0,    0,    0,    0,    0,    0,
+     0,    1,    1,    1,    1,    1,    1,    1,
+     1,    1,    1,    1,    1,    1,    1,    1,
+     1,    1,    2,    2,    2,    2,    3,    3,
+     3,    3,    3,    3,    3,    3,    3,    3,
+     3,    3,    3,    3,    3,    3,    3,    3,
+     3,    3,    3,    3,    3,    3,    3,    3,
+};
+
+// Слоты по возрастанию ID, [0] - для ID вне таблицы
+const uint16_t can_dispatch_slots[CAN_DISPATCH_STD_IDS + 1] = {
+  CAN_DISPATCH_NONE,
+  CAN_DISPATCH_SLOT(CAN_DISPATCH_DB, 0),  // 0x201 ECM_Engine1
+  CAN_DISPATCH_SLOT(CAN_DISPATCH_DB, 1),  // 0x420 ECM_Engine2
+  CAN_DISPATCH_SLOT(CAN_DISPATCH_DB, 2),  // 0x4B0 ABS_Wheels
+  CAN_DISPATCH_SLOT(CAN_DISPATCH_ISOTP, 0),  // 0x7E8 ответ ECU
+  CAN_DISPATCH_SLOT(CAN_DISPATCH_ISOTP, 1),  // 0x7E9 ответ ECU
+  CAN_DISPATCH_SLOT(CAN_DISPATCH_ISOTP, 2),  // 0x7EA ответ ECU
+  CAN_DISPATCH_SLOT(CAN_DISPATCH_ISOTP, 3),  // 0x7EB ответ ECU
+  CAN_DISPATCH_SLOT(CAN_DISPATCH_ISOTP, 4),  // 0x7EC ответ ECU
+  CAN_DISPATCH_SLOT(CAN_DISPATCH_ISOTP, 5),  // 0x7ED ответ ECU
+  CAN_DISPATCH_SLOT(CAN_DISPATCH_ISOTP, 6),  // 0x7EE ответ ECU
+  CAN_DISPATCH_SLOT(CAN_DISPATCH_ISOTP, 7),  // 0x7EF ответ ECU
+};
@@ -0,0 +1,288 @@
+#include "main.h"
+#include "isotp.h"
+#include "uds.h"
+#include <string.h>
+
+/**
+  * @brief  Отправка кадра ISO-TP через очередь передачи, дополненного до 8 байт.
+  * @param  sent_us: Отметка ухода кадра на шину (MCP2515_TX_Enqueue_Tracked), NULL - не нужна
+  * @retval 1 - кадр в очереди, 0 - очередь заполнена
+  */
+static uint8_t ISOTP_Send_CAN(ISOTP_Link *link, uint32_t can_id, const uint8_t *data,
+                              uint8_t len, uint8_t priority, volatile uint32_t *sent_us)
+{
+  CAN_Frame frame;
+
+  frame.id = can_id;
+  frame.extended = link->extended;
+  frame.rtr = 0;
+  frame.dlc = 8;
+  frame.timestamp = 0;
+  memcpy(frame.data, data, len);
+  memset(&frame.data[len], ISOTP_PADDING, 8 - len);
+  return MCP2515_TX_Enqueue_Tracked(&frame, priority, MCP2515_TX_TIMEOUT_DEFAULT, sent_us);
+}
+
+/**
+  * @brief  Flow Control получателя: FC идет вне очереди с высшим приоритетом,
+  *         иначе отправитель простоит в ожидании за нашими запросами.
+  */
+static void ISOTP_Send_FC(ISOTP_Link *link, uint8_t flow_status)
+{
+  uint8_t fc[3] = {ISOTP_PCI_FC | flow_status, link->block_size, link->st_min};
+  ISOTP_Send_CAN(link, link->fc_id, fc, 3, MCP2515_TX_PRIO_LEVELS - 1, NULL);
+}
+
+/**
+  * @brief  STmin из FC в микросекундах (ISO 15765-2, таблица 20)
+  */
+static uint32_t ISOTP_STmin_Us(uint8_t st_min)
+{
+  if (st_min <= 0x7F) return st_min * 1000u;
+  if (st_min >= 0xF1 && st_min <= 0xF9) return (st_min - 0xF0) * 100u;
+  return 0x7F * 1000u; // Зарезервированные значения - максимальная пауза
+}
+
+void ISOTP_Init(ISOTP_Link *link, uint32_t tx_id, uint32_t rx_id, uint8_t extended)
+{
+  memset(link, 0, sizeof(*link));
+  link->tx_id = tx_id;
+  link->rx_id = rx_id;
+  link->fc_id = tx_id;
+  link->extended = extended;
+  link->n_bs_ms = ISOTP_N_BS_MS;
+  link->n_cr_ms = ISOTP_N_CR_MS;
+}
+
+uint8_t ISOTP_Send(ISOTP_Link *link, const uint8_t *data, uint16_t len)
+{
+  uint8_t frame[8];
+
+  if (link->tx_state != ISOTP_IDLE || len == 0 || len > ISOTP_BUF_SIZE || len > 4095) return 0;
+
+  // Single Frame
+  if (len <= 7) {
+    frame[0] = ISOTP_PCI_SF | len;
+    memcpy(&frame[1], data, len);
+    if (!ISOTP_Send_CAN(link, link->tx_id, frame, len + 1, MCP2515_TX_PRIO_DEFAULT, NULL)) return 0;
+    link->tx_result = ISOTP_OK;
+    return 1;
+  }
+
+  // First Frame, остальное после FC
+  memcpy(link->tx_buf, data, len);
+  frame[0] = ISOTP_PCI_FF | (len >> 8);
+  frame[1] = (uint8_t)len;
+  memcpy(&frame[2], data, 6);
+  if (!ISOTP_Send_CAN(link, link->tx_id, frame, 8, MCP2515_TX_PRIO_DEFAULT, NULL)) return 0;
+
+  link->tx_len = len;
+  link->tx_pos = 6;
+  link->tx_sn = 1;
+  link->tx_wft = 0;
+  link->tx_timer = HAL_GetTick();
+  link->tx_result = ISOTP_BUSY;
+  link->tx_state = ISOTP_TX_WAIT_FC;
+  return 1;
+}
+
+/**
+  * @brief  Прием FC отправителем
+  */
+static void ISOTP_On_FC(ISOTP_Link *link, const CAN_Frame *frame)
+{
+  if (link->tx_state != ISOTP_TX_WAIT_FC || frame->dlc < 3) return;
+
+  switch (frame->data[0] & 0x0F) {
+    case ISOTP_FC_CTS:
+      link->tx_bs = frame->data[1];
+      link->tx_bs_left = link->tx_bs;
+      link->tx_st_us = ISOTP_STmin_Us(frame->data[2]);
+      link->tx_last_us = (micros() - link->tx_st_us) | 1; // Первый CF без паузы
+      link->tx_wft = 0;
+      link->tx_state = ISOTP_TX_CF;
+      break;
+    case ISOTP_FC_WAIT:
+      link->tx_timer = HAL_GetTick();
+      if (++link->tx_wft > ISOTP_MAX_WFT) {
+        link->tx_result = ISOTP_ERR_FC;
+        link->tx_state = ISOTP_IDLE;
+      }
+      break;
+    case ISOTP_FC_OVFLW:
+      link->tx_result = ISOTP_ERR_OVERFLOW;
+      link->tx_state = ISOTP_IDLE;
+      break;
+    default:
+      link->tx_result = ISOTP_ERR_FC;
+      link->tx_state = ISOTP_IDLE;
+      break;
+  }
+}
+
+uint8_t ISOTP_On_Frame(ISOTP_Link *link, const CAN_Frame *frame)
+{
+  const uint8_t *d = frame->data;
+
+  if (frame->id != link->rx_id || frame->extended != link->extended || frame->rtr) return 0;
+  if (frame->dlc == 0) return 1;
+
+  switch (d[0] & 0xF0) {
+    case ISOTP_PCI_SF: {
+      // Новый SF прерывает незавершенный прием
+      uint8_t len = d[0] & 0x0F;
+      if (len == 0 || len > 7 || len > frame->dlc - 1) break;
+      memcpy(link->rx_buf, &d[1], len);
+      link->rx_len = len;
+      link->rx_result = ISOTP_OK;
+      link->rx_state = ISOTP_RX_DONE;
+      break;
+    }
+    case ISOTP_PCI_FF: {
+      uint16_t len = ((d[0] & 0x0F) << 8) | d[1];
+      if (frame->dlc < 8 || len < 8) break;
+      if (len > ISOTP_BUF_SIZE) {
+        ISOTP_Send_FC(link, ISOTP_FC_OVFLW);
+        link->rx_result = ISOTP_ERR_OVERFLOW;
+        link->rx_state = ISOTP_IDLE;
+        break;
+      }
+      memcpy(link->rx_buf, &d[2], 6);
+      link->rx_len = len;
+      link->rx_pos = 6;
+      link->rx_sn = 1;
+      link->rx_bs_left = link->block_size;
+      link->rx_timer = HAL_GetTick();
+      link->rx_result = ISOTP_BUSY;
+      link->rx_state = ISOTP_RX_CF;
+      ISOTP_Send_FC(link, ISOTP_FC_CTS);
+      break;
+    }
+    case ISOTP_PCI_CF: {
+      if (link->rx_state != ISOTP_RX_CF) break;
+      if ((d[0] & 0x0F) != link->rx_sn) {
+        link->rx_result = ISOTP_ERR_WRONG_SN;
+        link->rx_state = ISOTP_IDLE;
+        break;
+      }
+      uint16_t n = link->rx_len - link->rx_pos;
+      if (n > 7) n = 7;
+      if (n > frame->dlc - 1) n = frame->dlc - 1;
+      memcpy(&link->rx_buf[link->rx_pos], &d[1], n);
+      link->rx_pos += n;
+      link->rx_sn = (link->rx_sn + 1) & 0x0F;
+      link->rx_timer = HAL_GetTick();
+
+      if (link->rx_pos >= link->rx_len) {
+        link->rx_result = ISOTP_OK;
+        link->rx_state = ISOTP_RX_DONE;
+      } else if (link->block_size && --link->rx_bs_left == 0) {
+        link->rx_bs_left = link->block_size;
+        ISOTP_Send_FC(link, ISOTP_FC_CTS);
+      }
+      break;
+    }
+    case ISOTP_PCI_FC:
+      ISOTP_On_FC(link, frame);
+      break;
+    default:
+      break;
+  }
+  return 1;
+}
+
+void ISOTP_Poll(ISOTP_Link *link)
+{
+  uint32_t now = HAL_GetTick();
+
+  if (link->tx_state == ISOTP_TX_WAIT_FC && (now - link->tx_timer) > link->n_bs_ms) {
+    link->tx_result = ISOTP_ERR_TIMEOUT_BS;
+    link->tx_state = ISOTP_IDLE;
+  }
+
+  // CF подряд, пока позволяют STmin и место в очереди передачи. При STmin > 0 в
+  // очереди не больше одного CF, пауза - от его ухода на шину: застрявший за
+  // другими кадрами CF иначе ушел бы вплотную к следующему
+  while (link->tx_state == ISOTP_TX_CF) {
+    uint8_t frame[8];
+    uint32_t last_us = link->tx_last_us;
+    if (link->tx_st_us && (!last_us || (micros() - last_us) < link->tx_st_us)) break;
+
+    uint16_t n = link->tx_len - link->tx_pos;
+    if (n > 7) n = 7;
+    frame[0] = ISOTP_PCI_CF | link->tx_sn;
+    memcpy(&frame[1], &link->tx_buf[link->tx_pos], n);
+    link->tx_last_us = 0; // Отметку поставит передача MCP2515
+    if (!ISOTP_Send_CAN(link, link->tx_id, frame, n + 1, MCP2515_TX_PRIO_DEFAULT,
+                        link->tx_st_us ? &link->tx_last_us : NULL)) {
+      link->tx_last_us = last_us;
+      break;
+    }
+
+    link->tx_pos += n;
+    link->tx_sn = (link->tx_sn + 1) & 0x0F;
+    if (link->tx_pos >= link->tx_len) {
+      link->tx_result = ISOTP_OK;
+      link->tx_state = ISOTP_IDLE;
+    } else if (link->tx_bs && --link->tx_bs_left == 0) {
+      link->tx_timer = now;
+      link->tx_state = ISOTP_TX_WAIT_FC;
+    }
+  }
+
+  if (link->rx_state == ISOTP_RX_CF && (now - link->rx_timer) > link->n_cr_ms) {
+    link->rx_result = ISOTP_ERR_TIMEOUT_CR;
+    link->rx_state = ISOTP_IDLE;
+  }
+}
+
+uint16_t ISOTP_Receive(ISOTP_Link *link, const uint8_t **data)
+{
+  if (link->rx_state != ISOTP_RX_DONE) return 0;
+  link->rx_state = ISOTP_IDLE;
+  *data = link->rx_buf;
+  return link->rx_len;
+}
+
+uint16_t ISOTP_Request(ISOTP_Link *link, const uint8_t *req, uint16_t req_len,
+                       uint8_t *resp, uint16_t resp_max, uint32_t timeout_ms)
+{
+  uint32_t start = HAL_GetTick();
+  const uint8_t *data;
+  CAN_Frame frame;
+
+  link->rx_state = ISOTP_IDLE; // Старый непрочитанный ответ не нужен
+  link->rx_result = ISOTP_BUSY;
+  if (!ISOTP_Send(link, req, req_len)) return 0;
+
+  while ((HAL_GetTick() - start) < timeout_ms) {
+    while (MCP2515_RX_Pop(&frame)) {
+      ISOTP_On_Frame(link, &frame);
+    }
+    ISOTP_Poll(link);
+
+    uint16_t len = ISOTP_Receive(link, &data);
+    if (len && UDS_Classify(data, len, req[0]) == UDS_RESP_PENDING) {
+      // ECU принял запрос и просит подождать: окончательный ответ - в пределах P2*
+      start = HAL_GetTick();
+      timeout_ms = UDS_P2_STAR_MS;
+      link->rx_result = ISOTP_BUSY;
+      continue;
+    }
+    if (len) {
+      if (len > resp_max) len = resp_max;
+      memcpy(resp, data, len);
+      return len;
+    }
+    if (link->tx_state == ISOTP_IDLE && link->tx_result != ISOTP_OK) return 0;
+    if (link->rx_state == ISOTP_IDLE && link->rx_result != ISOTP_BUSY) return 0;
+
+    if (MCP2515_TX_Pending()) {
+      MCP2515_TX_Service();
+    }
+    if (link->tx_state != ISOTP_TX_CF) {
+      __WFI(); // Спим до следующего кадра или SysTick
+    }
+  }
+  return 0;
+}
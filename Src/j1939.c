@@ -0,0 +1,395 @@
+#include "main.h"
+#include "j1939.h"
+#include <string.h>
+
+// SPN из целых байтов или бит: raw * num / den + offset, decimals знаков после запятой
+#define SPN_F(spn, pgn, pos, shift, bits, num, den, offset, dec, unit, name) \
+  { spn, pgn, pos, shift, bits, OBD_UNIT_##unit, dec, num, den, offset, name }
+// Двухбитное состояние DM1: 0 - выкл, 1 - вкл, 2 - ошибка, 3 - нет данных
+#define SPN_LAMP(spn, shift, name) \
+  SPN_F(spn, J1939_PGN_DM1, 0, shift, 2, 1, 1, 0, 0, NONE, name)
+
+// SPN по возрастанию номера (J1939-71, J1939-73)
+static const J1939_SPN_Field spn_fields[] = {
+  SPN_F(84,   J1939_PGN_CCVS,  1, 0, 16, 25, 64, 0, 2, KMH, "Vehicle speed"),       // 1/256 км/ч
+  SPN_F(91,   J1939_PGN_EEC2,  1, 0, 8, 4, 1, 0, 1, PERCENT, "Accelerator pedal"),  // 0.4 %
+  SPN_F(100,  J1939_PGN_EFLP1, 3, 0, 8, 4, 1, 0, 0, KPA, "Oil pressure"),           // 4 кПа
+  SPN_F(110,  J1939_PGN_ET1,   0, 0, 8, 1, 1, -40, 0, DEG_C, "Coolant"),
+  SPN_F(175,  J1939_PGN_ET1,   2, 0, 16, 5, 16, -2730, 1, DEG_C, "Oil temperature"), // 1/32 °C - 273
+  SPN_F(190,  J1939_PGN_EEC1,  3, 0, 16, 25, 2, 0, 2, RPM, "Engine RPM"),           // 0.125 об/мин
+  SPN_F(513,  J1939_PGN_EEC1,  2, 0, 8, 1, 1, -125, 0, PERCENT, "Engine torque"),
+  SPN_LAMP(623,  4, "Red stop lamp"),
+  SPN_LAMP(624,  2, "Amber warning lamp"),
+  SPN_LAMP(987,  0, "Protect lamp"),
+  SPN_LAMP(1213, 6, "MIL"),
+};
+#define SPN_FIELD_COUNT  (sizeof(spn_fields) / sizeof(spn_fields[0]))
+
+void J1939_Parse_ID(uint32_t can_id, J1939_ID *id)
+{
+  uint8_t pf = (can_id >> 16) & 0xFF;
+
+  id->priority = (can_id >> 26) & 0x07;
+  id->sa = (uint8_t)can_id;
+  if (pf < 240) {
+    // PDU1: PS - адрес назначения, в PGN не входит
+    id->pgn = (can_id >> 8) & 0x3FF00;
+    id->da = (can_id >> 8) & 0xFF;
+  } else {
+    id->pgn = (can_id >> 8) & 0x3FFFF;
+    id->da = J1939_GLOBAL_ADDRESS;
+  }
+}
+
+uint32_t J1939_Make_ID(uint8_t priority, uint32_t pgn, uint8_t da, uint8_t sa)
+{
+  uint32_t id = ((uint32_t)(priority & 0x07) << 26) | ((pgn & 0x3FFFF) << 8) | sa;
+
+  if (((pgn >> 8) & 0xFF) < 240) id = (id & ~0xFF00u) | ((uint32_t)da << 8);
+  return id;
+}
+
+const J1939_SPN_Field *J1939_SPN_Find(uint16_t spn)
+{
+  uint8_t lo = 0, hi = SPN_FIELD_COUNT;
+
+  while (lo < hi) {
+    uint8_t mid = (lo + hi) / 2;
+    if (spn_fields[mid].spn < spn) lo = mid + 1;
+    else hi = mid;
+  }
+  return (lo < SPN_FIELD_COUNT && spn_fields[lo].spn == spn) ? &spn_fields[lo] : NULL;
+}
+
+uint8_t J1939_SPN_Decode(const J1939_SPN_Field *field, const uint8_t *data, uint16_t len, int32_t *value)
+{
+  uint8_t bytes = (field->shift + field->bits + 7) / 8;
+  uint32_t raw = 0;
+
+  if (len < field->pos + bytes) return 0;
+  for (uint8_t i = bytes; i > 0; i--) raw = (raw << 8) | data[field->pos + i - 1];
+  raw >>= field->shift;
+  if (field->bits < 32) raw &= (1u << field->bits) - 1;
+
+  // J1939-71: 0xFB.. (0xFBxx ..) - зарезервировано, 0xFE - ошибка, 0xFF - нет данных;
+  // у битовых полей "нет данных" - все единицы
+  if (field->bits >= 8) {
+    uint32_t max_valid = (0xFAu << (field->bits - 8)) | ((1u << (field->bits - 8)) - 1);
+    if (raw > max_valid) return 0;
+  } else if (raw == (1u << field->bits) - 1) {
+    return 0;
+  }
+  if (field->den == 1) *value = (int32_t)raw * field->num + field->offset;
+  else *value = (int32_t)raw * field->num / field->den + field->offset;
+  return 1;
+}
+
+uint8_t J1939_Parse_DM1(const uint8_t *data, uint16_t len, J1939_DM1 *dm1)
+{
+  uint8_t count = 0;
+
+  if (len < 2) return 0;
+  dm1->mil = (data[0] >> 6) & 0x03;
+  dm1->red_stop = (data[0] >> 4) & 0x03;
+  dm1->amber = (data[0] >> 2) & 0x03;
+  dm1->protect = data[0] & 0x03;
+
+  // SPN: 8 бит + 8 бит + старшие 3 бита третьего байта (SPN conversion method 0)
+  for (uint16_t pos = 2; pos + 4 <= len; pos += 4) {
+    uint32_t spn = data[pos] | ((uint32_t)data[pos + 1] << 8) | ((uint32_t)(data[pos + 2] >> 5) << 16);
+    if (spn == 0) continue; // "Нет активных DTC": SPN 0, FMI 0
+    if (count < J1939_DM1_MAX) {
+      dm1->dtc[count].spn = spn;
+      dm1->dtc[count].fmi = data[pos + 2] & 0x1F;
+      dm1->dtc[count].oc = data[pos + 3] & 0x7F;
+    }
+    count++;
+  }
+  dm1->count = count;
+  return count;
+}
+
+/**
+  * @brief  Отправка кадра со своего адреса
+  */
+static uint8_t J1939_Send(const J1939_Stack *j, uint8_t priority, uint32_t pgn, uint8_t da,
+                          const uint8_t *data)
+{
+  return MCP2515_Send_Frame(J1939_Make_ID(priority, pgn, da, j->address), 1, 8, data);
+}
+
+/**
+  * @brief  Address Claimed со своим NAME (с адреса J1939_NULL_ADDRESS - Cannot Claim)
+  */
+static void J1939_Send_Claim(const J1939_Stack *j)
+{
+  uint8_t data[8];
+
+  for (uint8_t i = 0; i < 8; i++) data[i] = (uint8_t)(j->name >> (8 * i));
+  J1939_Send(j, 6, J1939_PGN_ADDRESS_CLAIM, J1939_GLOBAL_ADDRESS, data);
+}
+
+void J1939_Init(J1939_Stack *j, uint64_t name, uint8_t address, J1939_Signal *signals, uint8_t count)
+{
+  memset(j, 0, sizeof(*j));
+  j->name = name;
+  j->address = address;
+  j->signals = signals;
+  j->signal_count = count;
+  j->dm1_sa = J1939_GLOBAL_ADDRESS;
+  for (uint8_t i = 0; i < count; i++) signals[i].valid = 0;
+
+  if (address != J1939_NULL_ADDRESS) {
+    J1939_Send_Claim(j);
+    j->claiming = 1;
+    j->claim_tick = HAL_GetTick();
+  }
+}
+
+/**
+  * @brief  Диапазон ID одного PGN от любого источника
+  */
+static void J1939_Range(CAN_Filter_Range *range, uint8_t priority, uint32_t pgn, uint8_t da)
+{
+  range->id_from = J1939_Make_ID(priority, pgn, da, 0x00);
+  range->id_to = J1939_Make_ID(priority, pgn, da, 0xFF);
+  range->extended = 1;
+}
+
+uint8_t J1939_Filter_Ranges(const J1939_Stack *j, CAN_Filter_Range *ranges, uint8_t max)
+{
+  uint32_t pgns[16];
+  uint8_t pgn_count = 0;
+  uint8_t count = 0;
+
+  // PGN отслеживаемых SPN без повторов
+  pgns[pgn_count++] = J1939_PGN_DM1;
+  for (uint8_t i = 0; i < j->signal_count && pgn_count < sizeof(pgns) / sizeof(pgns[0]); i++) {
+    const J1939_SPN_Field *field = J1939_SPN_Find(j->signals[i].spn);
+    if (!field) continue;
+    uint8_t k = 0;
+    while (k < pgn_count && pgns[k] != field->pgn) k++;
+    if (k == pgn_count) pgns[pgn_count++] = field->pgn;
+  }
+  for (uint8_t k = 0; k < pgn_count && count < max; k++) {
+    // Приоритеты по умолчанию: управление двигателем - 3, остальное - 6
+    uint8_t priority = (pgns[k] == J1939_PGN_EEC1 || pgns[k] == J1939_PGN_EEC2) ? 3 : 6;
+    J1939_Range(&ranges[count++], priority, pgns[k], J1939_GLOBAL_ADDRESS);
+  }
+
+  // Транспорт: BAM всем, RTS/CTS - нам
+  if (count < max) J1939_Range(&ranges[count++], 7, J1939_PGN_TP_CM, J1939_GLOBAL_ADDRESS);
+  if (count < max) J1939_Range(&ranges[count++], 7, J1939_PGN_TP_DT, J1939_GLOBAL_ADDRESS);
+  if (j->address == J1939_NULL_ADDRESS) return count;
+  if (count < max) J1939_Range(&ranges[count++], 7, J1939_PGN_TP_CM, j->address);
+  if (count < max) J1939_Range(&ranges[count++], 7, J1939_PGN_TP_DT, j->address);
+  if (count < max) J1939_Range(&ranges[count++], 6, J1939_PGN_REQUEST, J1939_GLOBAL_ADDRESS);
+  if (count < max) J1939_Range(&ranges[count++], 6, J1939_PGN_REQUEST, j->address);
+  if (count < max) J1939_Range(&ranges[count++], 6, J1939_PGN_ADDRESS_CLAIM, J1939_GLOBAL_ADDRESS);
+  return count;
+}
+
+/**
+  * @brief  Целое сообщение: отслеживаемые SPN, DM1, приложению
+  */
+static void J1939_Dispatch(J1939_Stack *j, uint32_t pgn, uint8_t sa, const uint8_t *data, uint16_t len)
+{
+  j->messages++;
+  for (uint8_t i = 0; i < j->signal_count; i++) {
+    J1939_Signal *sig = &j->signals[i];
+    if (sig->sa != J1939_GLOBAL_ADDRESS && sig->sa != sa) continue;
+    const J1939_SPN_Field *field = J1939_SPN_Find(sig->spn);
+    if (!field || field->pgn != pgn) continue;
+    sig->valid = J1939_SPN_Decode(field, data, len, &sig->value);
+    sig->from = sa;
+    sig->updated = HAL_GetTick();
+  }
+  if (pgn == J1939_PGN_DM1 && (j->dm1_sa == J1939_GLOBAL_ADDRESS || j->dm1_sa == sa)) {
+    J1939_Parse_DM1(data, len, &j->dm1);
+    j->dm1.sa = sa;
+    j->dm1.updated = HAL_GetTick();
+  }
+  if (j->on_pgn) j->on_pgn(pgn, sa, data, len);
+}
+
+/**
+  * @brief  Управляющий кадр TP.CM к отправителю сборки s
+  */
+static void J1939_TP_Send(const J1939_Stack *j, const J1939_TP_Session *s, uint8_t control,
+                          uint8_t b1, uint8_t b2, uint8_t b3, uint8_t b4)
+{
+  uint8_t data[8] = {control, b1, b2, b3, b4, (uint8_t)s->pgn, (uint8_t)(s->pgn >> 8), (uint8_t)(s->pgn >> 16)};
+
+  J1939_Send(j, 7, J1939_PGN_TP_CM, s->sa, data);
+}
+
+/**
+  * @brief  CMDT: CTS на следующее окно пакетов
+  */
+static void J1939_TP_Send_CTS(const J1939_Stack *j, J1939_TP_Session *s, uint32_t now)
+{
+  uint8_t n = s->packets - s->next + 1;
+
+  if (n > s->max_cts) n = s->max_cts;
+  if (n > J1939_CTS_PACKETS) n = J1939_CTS_PACKETS;
+  s->window_end = s->next + n - 1;
+  s->deadline = now + J1939_T2_MS;
+  J1939_TP_Send(j, s, J1939_TP_CTS, n, s->next, 0xFF, 0xFF);
+}
+
+/**
+  * @brief  Сборка от источника sa: широковещательная или к нам
+  */
+static J1939_TP_Session *J1939_TP_Find(J1939_Stack *j, uint8_t sa, uint8_t bam)
+{
+  for (uint8_t i = 0; i < J1939_TP_SESSIONS; i++) {
+    J1939_TP_Session *s = &j->tp[i];
+    if (s->active && s->sa == sa && s->bam == bam) return s;
+  }
+  return NULL;
+}
+
+/**
+  * @brief  TP.CM: начало сборки (BAM, RTS) или Abort от отправителя
+  */
+static void J1939_TP_Control(J1939_Stack *j, const J1939_ID *id, const uint8_t *data, uint32_t now)
+{
+  uint8_t bam = id->da == J1939_GLOBAL_ADDRESS;
+  J1939_TP_Session *s = J1939_TP_Find(j, id->sa, bam);
+
+  if (data[0] == J1939_TP_ABORT) {
+    if (s) {
+      s->active = 0;
+      j->tp_aborts++;
+    }
+    return;
+  }
+  if (data[0] != (bam ? J1939_TP_BAM : J1939_TP_RTS)) return; // CTS/EOMA - мы не отправляем
+  if (!bam && (j->address == J1939_NULL_ADDRESS || j->claiming)) return;
+
+  if (s) j->tp_aborts++; // Новое сообщение прерывает незаконченное
+  for (uint8_t i = 0; !s && i < J1939_TP_SESSIONS; i++) {
+    if (!j->tp[i].active) s = &j->tp[i];
+  }
+
+  J1939_TP_Session tmp;
+  uint16_t size = data[1] | (data[2] << 8);
+  if (!s) s = &tmp; // Места нет - только для Abort
+  s->sa = id->sa;
+  s->bam = bam;
+  s->pgn = data[5] | ((uint32_t)data[6] << 8) | ((uint32_t)data[7] << 16);
+  s->active = 0;
+  if (s == &tmp || size > J1939_TP_SIZE || size < 9 || data[3] != (size + 6) / 7) {
+    if (!bam) J1939_TP_Send(j, s, J1939_TP_ABORT, 2, 0xFF, 0xFF, 0xFF); // Нет ресурсов
+    return;
+  }
+
+  s->active = 1;
+  s->size = size;
+  s->packets = data[3];
+  s->next = 1;
+  s->max_cts = (bam || data[4] == 0) ? 0xFF : data[4];
+  s->deadline = now + J1939_T1_MS;
+  if (!bam) J1939_TP_Send_CTS(j, s, now);
+}
+
+/**
+  * @brief  TP.DT: очередной пакет сборки
+  */
+static void J1939_TP_Data(J1939_Stack *j, const J1939_ID *id, const uint8_t *data, uint32_t now)
+{
+  uint8_t bam = id->da == J1939_GLOBAL_ADDRESS;
+  J1939_TP_Session *s = J1939_TP_Find(j, id->sa, bam);
+
+  if (!s) return;
+  if (data[0] != s->next) {
+    // Пропуск пакета: BAM не повторить; CMDT - отказ, отправитель начнет заново
+    s->active = 0;
+    j->tp_aborts++;
+    if (!bam) J1939_TP_Send(j, s, J1939_TP_ABORT, 3, 0xFF, 0xFF, 0xFF);
+    return;
+  }
+
+  uint16_t pos = (uint16_t)(s->next - 1) * 7;
+  uint8_t n = s->size - pos < 7 ? s->size - pos : 7;
+  memcpy(&s->data[pos], &data[1], n);
+  s->deadline = now + J1939_T1_MS;
+
+  if (s->next++ == s->packets) {
+    s->active = 0;
+    if (!bam) {
+      J1939_TP_Send(j, s, J1939_TP_EOMA, (uint8_t)s->size, s->size >> 8, s->packets, 0xFF);
+    }
+    J1939_Dispatch(j, s->pgn, s->sa, s->data, s->size);
+  } else if (!bam && data[0] == s->window_end) {
+    J1939_TP_Send_CTS(j, s, now);
+  }
+}
+
+/**
+  * @brief  Чужой Address Claimed на наш адрес: меньший NAME побеждает
+  */
+static void J1939_Claim_Contest(J1939_Stack *j, const uint8_t *data)
+{
+  uint64_t name = 0;
+
+  for (uint8_t i = 8; i > 0; i--) name = (name << 8) | data[i - 1];
+  if (name < j->name) {
+    j->address = J1939_NULL_ADDRESS; // Адрес за ними: Cannot Claim, дальше только прием
+    j->claiming = 0;
+  }
+  J1939_Send_Claim(j);
+}
+
+uint8_t J1939_On_Frame(J1939_Stack *j, const CAN_Frame *frame)
+{
+  J1939_ID id;
+  uint32_t now = HAL_GetTick();
+
+  if (!frame->extended || frame->rtr) return 0;
+  J1939_Parse_ID(frame->id, &id);
+
+  switch (id.pgn) {
+    case J1939_PGN_TP_CM:
+    case J1939_PGN_TP_DT:
+      // Сборки между другими узлами не собираем: только BAM и к нам
+      if (frame->dlc < 8 || (id.da != J1939_GLOBAL_ADDRESS && id.da != j->address)) break;
+      if (id.pgn == J1939_PGN_TP_CM) J1939_TP_Control(j, &id, frame->data, now);
+      else J1939_TP_Data(j, &id, frame->data, now);
+      break;
+
+    case J1939_PGN_ADDRESS_CLAIM:
+      if (frame->dlc >= 8 && j->address != J1939_NULL_ADDRESS && id.sa == j->address) {
+        J1939_Claim_Contest(j, frame->data);
+      }
+      break;
+
+    case J1939_PGN_REQUEST:
+      // Запрос Address Claimed - отвечаем все, у кого есть адрес
+      if (frame->dlc >= 3 && j->address != J1939_NULL_ADDRESS &&
+          (id.da == J1939_GLOBAL_ADDRESS || id.da == j->address) &&
+          (frame->data[0] | (frame->data[1] << 8) | ((uint32_t)frame->data[2] << 16)) == J1939_PGN_ADDRESS_CLAIM) {
+        J1939_Send_Claim(j);
+      }
+      break;
+
+    default:
+      J1939_Dispatch(j, id.pgn, id.sa, frame->data, frame->dlc);
+      break;
+  }
+  return 1;
+}
+
+void J1939_Task(J1939_Stack *j)
+{
+  uint32_t now = HAL_GetTick();
+
+  if (j->claiming && (now - j->claim_tick) >= J1939_CLAIM_MS) j->claiming = 0;
+  for (uint8_t i = 0; i < J1939_TP_SESSIONS; i++) {
+    J1939_TP_Session *s = &j->tp[i];
+    if (!s->active || (int32_t)(now - s->deadline) < 0) continue;
+    s->active = 0;
+    j->tp_aborts++;
+    if (!s->bam) J1939_TP_Send(j, s, J1939_TP_ABORT, 3, 0xFF, 0xFF, 0xFF); // Таймаут
+  }
+}
@@ -28,6 +28,14 @@
 #include "ads1115.h"
 #include "ssd1306.h"
 #include "mcp2515.h"
+#include "sniffer.h"
+#include "obd_sched.h"
+#include "obd_dtc.h"
+#include "obd_vehicle.h"
+#include "j1939.h"
+#include "can_db.h"
+#include "nvstore.h"
+#include "can_dispatch.h"
 extern uint8_t usb_com_open;
 extern uint8_t usb_trans_ok;
 /* USER CODE END Includes */
@@ -58,6 +66,33 @@ SPI_HandleTypeDef hspi1;
 UART_HandleTypeDef huart2;
 
 /* USER CODE BEGIN PV */
+static OBD_Sched obd_sched; // Буферы ISO-TP - не на стеке
+static OBD_DTC_Store dtc_store; // Коды ECU двигателя
+static OBD_Vehicle vehicle;     // VIN и конфигурация подключения (кэш во flash)
+// Сигналы приборной панели: опрашиваются планировщиком без ожидания ответов,
+// каждый со своим периодом
+static OBD_Signal dash[] = {
+  { .service = 0x01, .pid = PID_ENGINE_RPM,   .period_ms = 20    },
+  { .service = 0x01, .pid = PID_COOLANT_TEMP, .period_ms = 2000  },
+  { .service = 0x01, .pid = PID_DTC_STATUS,   .period_ms = 10000,
+    .on_update = OBD_DTC_On_Status, .context = &dtc_store },
+  // Списки DTC: при старте и при смене MIL/количества в PID 0x01
+  { .service = 0x03, .on_update = OBD_DTC_On_List, .context = &dtc_store },
+  { .service = 0x07, .on_update = OBD_DTC_On_List, .context = &dtc_store },
+  { .service = 0x0A, .on_update = OBD_DTC_On_List, .context = &dtc_store },
+};
+enum { DASH_RPM, DASH_COOLANT, DASH_DTC, DASH_DTC_STORED, DASH_DTC_PENDING, DASH_DTC_PERMANENT };
+// Грузовики (J1939): те же величины из широковещательных PGN, без запросов
+static J1939_Stack j1939;
+static J1939_Signal truck[] = {
+  { .spn = 190, .sa = J1939_GLOBAL_ADDRESS },  // Обороты, EEC1
+  { .spn = 110, .sa = J1939_GLOBAL_ADDRESS },  // Охлаждающая жидкость, ET1
+};
+enum { TRUCK_RPM, TRUCK_COOLANT };
+#ifdef USE_CAN_DB
+// Сигналы, которые ECU и так вещают (DBC автомобиля, Tools/dbc2c.py): старше - вещание пропало
+#define BROADCAST_MAX_AGE_MS  500
+#endif
 
 /* USER CODE END PV */
 
@@ -75,6 +110,15 @@ static void MX_I2C3_Init(void);
 
 /* Private user code ---------------------------------------------------------*/
 /* USER CODE BEGIN 0 */
+// Кадры, не относящиеся к каналам ECU: сигналам из DBC и стеку J1939
+// (PGN может быть описан и в DBC - отдаем обоим)
+static void Broadcast_Frame_Hook(const CAN_Frame *frame)
+{
+#ifdef USE_CAN_DB
+  CAN_DB_On_Frame(frame);
+#endif
+  if (vehicle.extended) J1939_On_Frame(&j1939, frame);
+}
 
 
 // Заводское калибровочное значение VREFINT (для STM32F401)
@@ -109,6 +153,97 @@ void Test_while_MCP2515(){
      printf("CANCTRL %d\n",MCP2515_Read_Register(MCP2515_REG_CANCTRL));
   }
 }
+
+// Сравнение стоимости отправки OBD запроса в тактах CPU (DWT->CYCCNT).
+// Старый путь: 11 транзакций WRITE по 3 байта + RTS = 34 байта SPI,
+// новый: LOAD TX BUFFER 14 байт + RTS = 15 байт SPI.
+// Оценка при SPI 937.5 кбит/с и HCLK 60 МГц (~512 тактов на байт):
+// старый ~19-20 тыс. тактов, новый ~8 тыс. тактов.
+// Контроллер переводится в loopback, чтобы кадры не уходили на шину.
+void Bench_MCP2515_TX(){
+  uint8_t tx_buffer[8] = {0x02, 0x01, PID_ENGINE_RPM, 0, 0, 0, 0, 0};
+  uint32_t t_old, t_new;
+
+  CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+  DWT->CYCCNT = 0;
+  DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+
+  MCP2515_Write_Register(MCP2515_REG_CANCTRL, 0x40); // Режим loopback
+  HAL_Delay(10);
+
+  // Старый путь: каждый регистр отдельной транзакцией
+  uint32_t start = DWT->CYCCNT;
+  MCP2515_Write_Register(MCP2515_REG_TXB0SIDH, (uint8_t)(CAN_OBD_REQUEST_ID >> 3));
+  MCP2515_Write_Register(MCP2515_REG_TXB0SIDL, (uint8_t)(CAN_OBD_REQUEST_ID << 5));
+  MCP2515_Write_Register(MCP2515_REG_TXB0DLC, 0x08);
+  for (int i = 0; i < 8; i++) {
+    MCP2515_Write_Register(MCP2515_REG_TXB0D0 + i, tx_buffer[i]);
+  }
+  MCP2515_Request_To_Send(0x01);
+  t_old = DWT->CYCCNT - start;
+  HAL_Delay(2);
+
+  // Новый путь: LOAD TX BUFFER + RTS
+  start = DWT->CYCCNT;
+  MCP2515_Load_TX_Buffer(0, CAN_OBD_REQUEST_ID, 0, 8, tx_buffer, 1);
+  t_new = DWT->CYCCNT - start;
+  HAL_Delay(2);
+
+  MCP2515_Write_Register(MCP2515_REG_CANCTRL, 0x00); // Нормальный режим
+  printf("TX cycles: old %lu, new %lu\n", t_old, t_new);
+}
+
+// Разбор принятого кадра в тактах CPU (DWT->CYCCNT) на потоке из всех 2048
+// 11-битных ID. Старый путь: сравнение с rx_id каждого канала ECU и двоичный
+// поиск по сообщениям DBC, новый - CAN_Dispatch_Std (карта + popcount).
+// Полная загрузка 500 кбит/с: 8-байтный кадр с 11-битным ID - от 111 бит,
+// до 4504 кадров/с.
+#define BENCH_BUS_FPS  (500000 / 111)
+static uint16_t Bench_Dispatch_Old(uint32_t id)
+{
+  static const uint32_t rx_ids[OBD_SCHED_MAX_ECUS] = {0x7E8, 0x7E9, 0x7EA, 0x7EB};
+  uint16_t lo = 0, hi = CAN_DB_MESSAGE_COUNT;
+
+  for (uint8_t i = 0; i < OBD_SCHED_MAX_ECUS; i++) {
+    if (id == rx_ids[i]) return CAN_DISPATCH_SLOT(CAN_DISPATCH_ISOTP, i);
+  }
+  while (lo < hi) {
+    uint16_t mid = (lo + hi) / 2;
+    if (can_db_messages[mid].id == id) return CAN_DISPATCH_SLOT(CAN_DISPATCH_DB, mid);
+    if (can_db_messages[mid].id < id) lo = mid + 1;
+    else hi = mid;
+  }
+  return CAN_DISPATCH_NONE;
+}
+
+void Bench_CAN_Dispatch(){
+  volatile uint16_t sink = 0;
+  uint32_t t_old, t_new, start;
+
+  CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+  DWT->CYCCNT = 0;
+  DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+
+  __disable_irq(); // Без прерываний INT/SysTick/USB в замере
+  start = DWT->CYCCNT;
+  for (uint32_t id = 0; id < 0x800; id++) sink = Bench_Dispatch_Old(id);
+  t_old = DWT->CYCCNT - start;
+
+  start = DWT->CYCCNT;
+  for (uint32_t id = 0; id < 0x800; id++) sink = CAN_Dispatch_Std(id);
+  t_new = DWT->CYCCNT - start;
+  __enable_irq();
+  (void)sink;
+
+  // Такты на кадр x100 и доля CPU x100 при полной загрузке шины
+  uint32_t old_x100 = t_old * 100 / 0x800, new_x100 = t_new * 100 / 0x800;
+  uint32_t cpu_old = (uint64_t)t_old * BENCH_BUS_FPS * 10000 / 0x800 / SystemCoreClock;
+  uint32_t cpu_new = (uint64_t)t_new * BENCH_BUS_FPS * 10000 / 0x800 / SystemCoreClock;
+  printf("Dispatch cycles/frame: old %lu.%02lu, new %lu.%02lu\n", old_x100 / 100, old_x100 % 100,
+         new_x100 / 100, new_x100 % 100);
+  printf("At %u frames/s: old %lu.%02lu%% CPU, new %lu.%02lu%% CPU\n", BENCH_BUS_FPS,
+         cpu_old / 100, cpu_old % 100, cpu_new / 100, cpu_new % 100);
+}
 /* USER CODE END 0 */
 
 /**
@@ -137,6 +272,7 @@ int main(void)
   setvbuf(stdin, NULL, _IONBF, 0);  
   setvbuf(stdout, NULL, _IONBF, 0);
   setvbuf(stderr, NULL, _IONBF, 0);
+  NV_Compact(); // Стирание сектора журнала - пока не включены USB и MCP2515
   /* USER CODE END SysInit */
 
   /* Initialize all configured peripherals */
@@ -161,7 +297,55 @@ int main(void)
     OLED_Clear(&oled);
 
   //Test_while_MCP2515();
-  MCP2515_Init_ISO15765();
+  //Bench_MCP2515_TX();
+  //Bench_CAN_Dispatch();
+  //Sniffer_Run(MCP2515_BITRATE_DEFAULT); // Все кадры шины в USB, не возвращается
+#ifdef DEBUG
+  print("PID table: %lu errors\n", OBD_PID_Self_Test()); // Сверка с Parse_*
+#endif
+  // Известный автомобиль - конфигурация по VIN одним запросом, иначе скорость,
+  // 11/29-битная адресация и ECU определяются по шине
+  uint8_t warm = OBD_Vehicle_Connect(&vehicle);
+  print("CAN %lu %s%s\n", vehicle.bitrate, vehicle.extended ? "29bit" : "11bit", warm ? " (VIN cache)" : "");
+  if (vehicle.vin[0]) print("VIN %s\n", vehicle.vin);
+  OBD_Sched_Init(&obd_sched, dash, sizeof(dash) / sizeof(dash[0]));
+  obd_sched.vehicle_key = OBD_Vehicle_Key(&vehicle);
+  dtc_store.fetch[0] = &dash[DASH_DTC_STORED];
+  dtc_store.fetch[1] = &dash[DASH_DTC_PENDING];
+  dtc_store.fetch[2] = &dash[DASH_DTC_PERMANENT];
+
+  // Все ECU - физической адресацией, ECU двигателя первым: сигналы dash ссылаются на индекс 0
+  CAN_Filter_Range ranges[OBD_MAX_ECUS + 1 + 16 + CAN_DB_MESSAGE_COUNT];
+  uint8_t engine = vehicle.extended ? 0x10 : 0;
+  uint8_t range_count = 0;
+  if (vehicle.ecu_count == 0 || vehicle.ecus[0].ecu != engine) {
+    // Не ответил (еще не проснулся?) - опрашиваем вслепую, как раньше
+    OBD_Sched_Add_ECU(&obd_sched, vehicle.extended, engine);
+    ranges[range_count].id_from = ranges[range_count].id_to = obd_sched.ecu[0].client.link.rx_id;
+    ranges[range_count++].extended = vehicle.extended;
+  }
+  for (uint8_t i = 0; i < vehicle.ecu_count; i++) {
+    print("ECU %lX\n", vehicle.ecus[i].rx_id);
+    OBD_Sched_Add_Found(&obd_sched, vehicle.extended, &vehicle.ecus[i]);
+    ranges[range_count].id_from = ranges[range_count].id_to = vehicle.ecus[i].rx_id;
+    ranges[range_count++].extended = vehicle.extended;
+  }
+  // 29 бит - возможно грузовик: широковещательные PGN J1939 слушаем вместе с OBD
+  if (vehicle.extended) {
+    J1939_Init(&j1939, J1939_NAME(J1939_FUNCTION_TOOL, 1), J1939_NULL_ADDRESS, truck, sizeof(truck) / sizeof(truck[0]));
+    range_count += J1939_Filter_Ranges(&j1939, &ranges[range_count], sizeof(ranges) / sizeof(ranges[0]) - range_count);
+  }
+#ifdef USE_CAN_DB
+  // Широковещательные сообщения из DBC - на частоте шины, без запросов
+  range_count += CAN_DB_Filter_Ranges(&ranges[range_count], sizeof(ranges) / sizeof(ranges[0]) - range_count);
+#endif
+  obd_sched.frame_hook = Broadcast_Frame_Hook;
+  // Фильтры MCP2515 - только ответы ECU, с которыми работаем, и вещание. Без ответивших
+  // ECU (грузовик только с J1939) тоже: фильтр автоопределения отсек бы все PGN
+  if (range_count) MCP2515_Init_Filtered(ranges, range_count, NULL);
+  uint32_t display_tick = HAL_GetTick();
+  uint32_t report_tick = display_tick;
+  //MCP2515_Init_ISO15765();
   //MCP2515_Init_With_Filter();
   //HAL_Delay(7000);
   /* USER CODE END 2 */
@@ -174,47 +358,105 @@ int main(void)
     //HAL_Delay(250);
     //HAL_GPIO_WritePin(GPIOC, GPIO_PIN_13, GPIO_PIN_SET);
     //HAL_Delay(250);
-    // Отправляем запрос RPM
-    uint8_t rx_data[8] = {0};
-
-    MCP2515_Send_OBD_Request(CAN_OBD_REQUEST_ID, PID_ENGINE_RPM); 
-    uint8_t data_length = MCP2515_Read_Message_Polling(rx_data, PID_ENGINE_RPM, 50);
-    if (data_length > 0) {
-      if(Handle_Negative_Response(rx_data, 8)){
-          OLED_WriteString(0,&oled,1,0, "rpm: er    ");
-      }else{
-          //printf("RPM %x %x %x %x %x %x %x %x\n",rx_data[0],rx_data[1],rx_data[2],rx_data[3],rx_data[4],rx_data[5],rx_data[6],rx_data[7]);
-          float engine_rpm = Parse_Engine_RPM(rx_data, 8);
-          OLED_WriteString(0,&oled,1,0, "rpm: %6.1f",engine_rpm);// 2567.1
+    // Запросы, ответы и таймауты - без ожидания, дисплей и USB не простаивают
+    OBD_Sched_Task(&obd_sched);
+    J1939_Task(&j1939);
+    if (HAL_GetTick() - display_tick < 100) {
+      continue;
+    }
+    display_tick = HAL_GetTick();
+
+    int32_t value;
+    // Значения из таблицы PID - целые с фиксированной точкой, без soft-float
+    if (dash[DASH_RPM].state == OBD_SIG_VALID &&
+        OBD_PID_Get(PID_ENGINE_RPM, 0, dash[DASH_RPM].data, dash[DASH_RPM].len, &value)) {
+      OLED_WriteString(0,&oled,1,0, "rpm: %4ld.%ld",value / 100,(value % 100) / 10);// 2567.1
+    }else if (truck[TRUCK_RPM].valid) {
+      value = truck[TRUCK_RPM].value; // Масштаб SPN 190 в таблице - как у PID 0x0C
+      OLED_WriteString(0,&oled,1,0, "rpm: %4ld.%ld",value / 100,(value % 100) / 10);
+#if defined(USE_CAN_DB) && defined(CAN_DB_ENGINE_SPEED)
+    }else if (CAN_DB_Get(CAN_DB_ENGINE_SPEED, 2, BROADCAST_MAX_AGE_MS, &value)) {
+      OLED_WriteString(0,&oled,1,0, "rpm: %4ld.%ld",value / 100,(value % 100) / 10);
+#endif
+    }else if(dash[DASH_RPM].state != OBD_SIG_NONE){
+      OLED_WriteString(0,&oled,1,0, "rpm: er    ");
+    }
+
+    if (dash[DASH_COOLANT].state == OBD_SIG_VALID &&
+        OBD_PID_Get(PID_COOLANT_TEMP, 0, dash[DASH_COOLANT].data, dash[DASH_COOLANT].len, &value)) {
+      OLED_WriteString(0,&oled,2,0, "t: %4ld  ",value);  // 103
+    }else if (truck[TRUCK_COOLANT].valid) {
+      OLED_WriteString(0,&oled,2,0, "t: %4ld  ",truck[TRUCK_COOLANT].value);
+#if defined(USE_CAN_DB) && defined(CAN_DB_COOLANT_TEMP)
+    }else if (CAN_DB_Get(CAN_DB_COOLANT_TEMP, 0, BROADCAST_MAX_AGE_MS, &value)) {
+      OLED_WriteString(0,&oled,2,0, "t: %4ld  ",value);
+#endif
+    }else if(dash[DASH_COOLANT].state != OBD_SIG_NONE){
+      OLED_WriteString(0,&oled,2,0, "t: er   ");
+    }
+
+    if (dtc_store.count) {
+      // Первый код и сколько всего (подтвержденные, ожидающие, постоянные)
+      char code[6];
+      OBD_DTC_Format(dtc_store.dtc[0].code, code);
+      OLED_WriteString(0,&oled,3,0, "%s %s x%u ",dtc_store.mil ? "MIL" : "dtc",code,dtc_store.count);
+    }else if (j1939.dm1.count) {
+      // DM1: первый SPN/FMI и сколько всего
+      OLED_WriteString(0,&oled,3,0, "%s %lu/%u x%u ",j1939.dm1.mil == 1 ? "MIL" : "dtc",
+                       j1939.dm1.dtc[0].spn,j1939.dm1.dtc[0].fmi,j1939.dm1.count);
+    }else if (dash[DASH_DTC].state == OBD_SIG_VALID &&
+        OBD_PID_Get(PID_DTC_STATUS, 0, dash[DASH_DTC].data, dash[DASH_DTC].len, &value)) {
+      // Поле 0 PID 0x01 - статус MIL
+      OLED_WriteString(0,&oled,3,0, "check: %2ld      ",value);
+    }else if(dash[DASH_DTC].state != OBD_SIG_NONE){
+      OLED_WriteString(0,&oled,3,0, "check: er");
+    }
+
+    // Потерянные кадры: переполнения RXB0/RXB1 + переполнения кольцевого буфера
+    uint32_t drops = mcp2515_stats.rx_overflow[0] + mcp2515_stats.rx_overflow[1] + mcp2515_stats.rx_ring_drops;
+    OLED_WriteString(1,&oled,0,0, "rx:%lu drop:%lu",mcp2515_stats.rx_frames,drops);
+
+    // Желаемая и достигнутая частота сигналов: видно, успевает ли ECU
+    if (HAL_GetTick() - report_tick >= 10000) {
+      report_tick = HAL_GetTick();
+      for (uint8_t i = 0; i < sizeof(dash) / sizeof(dash[0]); i++) {
+        uint16_t rate = OBD_Signal_Rate_x10(&dash[i]);
+        printf("PID %02X: %ums -> %ums, %u.%u Hz, %lu, timeout %ums\n", dash[i].pid, dash[i].period_ms,
+               dash[i].interval_ms, rate / 10, rate % 10, dash[i].updates, dash[i].latency.timeout_ms);
       }
-    }else{ print("RPM message not coming \n"); }  
-
-    //Отправляем запрос COOLANT
-    MCP2515_Send_OBD_Request(CAN_OBD_REQUEST_ID, PID_COOLANT_TEMP);  
-    if(MCP2515_Read_Message_Polling(rx_data, PID_COOLANT_TEMP, 50) > 0){
-      if(Handle_Negative_Response(rx_data, 8)){
-          OLED_WriteString(0,&oled,2,0, "t: er   ");
-      }else{
-        //printf("TEMP %x %x %x %x %x %x %x %x\n",rx_data[0],rx_data[1],rx_data[2],rx_data[3],rx_data[4],rx_data[5],rx_data[6],rx_data[7]);
-        float t = Parse_Coolant_Temperature(rx_data,8);
-        OLED_WriteString(0,&oled,2,0, "t: %5.1f",t);  // 103.4
+      // Гистограммы задержки ответа: "<=граница:счетчик" по непустым корзинам
+      for (uint8_t i = 0; i < obd_sched.ecu_count; i++) {
+        const OBD_Latency *lat = &obd_sched.ecu[i].latency;
+        printf("ECU %lX latency, timeout %ums:", obd_sched.ecu[i].client.link.rx_id, lat->timeout_ms);
+        for (uint8_t b = 0; b < OBD_LAT_BINS; b++) {
+          if (lat->bins[b]) printf(" <=%u:%u", OBD_Latency_Bin_Max(b), lat->bins[b]);
+        }
+        printf("\n");
       }
-    }else{ print("TEMP message not coming \n");}  
-
-    //Отправляем запрос Check Engine
-    MCP2515_Send_OBD_Request(CAN_OBD_REQUEST_ID, PID_DTC_STATUS); 
-    if(MCP2515_Read_Message_Polling(rx_data, PID_DTC_STATUS, 50) > 0){
-      if(Handle_Negative_Response(rx_data, 8)){
-          OLED_WriteString(0,&oled,3,0, "check: er");
-      }else{
-        //printf("DTC %x %x %x %x %x %x %x %x\n",rx_data[0],rx_data[1],rx_data[2],rx_data[3],rx_data[4],rx_data[5],rx_data[6],rx_data[7]);
-        DTC_Status dt = Parse_DTC_Status(rx_data,8);
-        OLED_WriteString(0,&oled,3,0, "check: %2d",dt.mil_status);
+#ifdef USE_CAN_DB
+      // Сигналы DBC: значение и сколько раз обновились за интервал
+      static uint32_t broadcast_updates[CAN_DB_SIGNAL_COUNT];
+      for (uint16_t i = 0; i < CAN_DB_SIGNAL_COUNT; i++) {
+        const CAN_DB_Value *v = &can_db_values[i];
+        if (!v->valid) continue;
+        uint8_t dec = can_db_signals[i].decimals;
+        int32_t mag = v->value < 0 ? -v->value : v->value;
+        int32_t scale = 1;
+        for (uint8_t d = 0; d < dec; d++) scale *= 10;
+        printf("DBC %s: %s%ld", can_db_signals[i].name, v->value < 0 ? "-" : "", mag / scale);
+        if (dec) printf(".%0*ld", dec, mag % scale);
+        printf(" %s, %lu/10s\n", OBD_Unit_Name(can_db_signals[i].unit), v->updates - broadcast_updates[i]);
+        broadcast_updates[i] = v->updates;
       }
-    }else{ print("DTC message not coming \n");}
-
-    //memset(rx_data,0,8);
-    OLED_WriteString(1,&oled,0,0, "data_length: %3d",data_length);
+#endif
+      for (uint8_t i = 0; i < obd_sched.ecu_count; i++) {
+        const OBD_Sched_ECU *e = &obd_sched.ecu[i];
+        for (uint8_t k = 0; k < e->nrc_count; k++) {
+          printf("ECU %lX: %02X NRC %02X x%u - %s\n", e->client.link.rx_id, e->nrc_stats[k].sid,
+                 e->nrc_stats[k].nrc, e->nrc_stats[k].count, UDS_NRC_Name(e->nrc_stats[k].nrc));
+        }
+      }
+    }
     /* USER CODE END WHILE */
 
     /* USER CODE BEGIN 3 */
@@ -410,7 +652,7 @@ static void MX_SPI1_Init(void)
   hspi1.Init.CLKPolarity = SPI_POLARITY_LOW;
   hspi1.Init.CLKPhase = SPI_PHASE_1EDGE;
   hspi1.Init.NSS = SPI_NSS_SOFT;
-  hspi1.Init.BaudRatePrescaler = SPI_BAUDRATEPRESCALER_64;
+  hspi1.Init.BaudRatePrescaler = SPI_BAUDRATEPRESCALER_8;
   hspi1.Init.FirstBit = SPI_FIRSTBIT_MSB;
   hspi1.Init.TIMode = SPI_TIMODE_DISABLE;
   hspi1.Init.CRCCalculation = SPI_CRCCALCULATION_DISABLE;
@@ -495,6 +737,16 @@ static void MX_GPIO_Init(void)
   GPIO_InitStruct.Speed = GPIO_SPEED_FREQ_LOW;
   HAL_GPIO_Init(CS__GPIO_Port, &GPIO_InitStruct);
 
+  /*Configure GPIO pin : MCP_INT_Pin */
+  GPIO_InitStruct.Pin = MCP_INT_Pin;
+  GPIO_InitStruct.Mode = GPIO_MODE_IT_FALLING;
+  GPIO_InitStruct.Pull = GPIO_PULLUP;
+  HAL_GPIO_Init(MCP_INT_GPIO_Port, &GPIO_InitStruct);
+
+  /* EXTI interrupt init*/
+  HAL_NVIC_SetPriority(EXTI1_IRQn, 5, 0);
+  HAL_NVIC_EnableIRQ(EXTI1_IRQn);
+
 /* USER CODE BEGIN MX_GPIO_Init_2 */
 /* USER CODE END MX_GPIO_Init_2 */
 }
@@ -515,6 +767,32 @@ int _write(int file, char *ptr, int len)
   return len;
 } 
 
+// Время в микросекундах от старта (HAL_GetTick + текущее значение SysTick).
+// Можно вызывать из прерываний с приоритетом выше SysTick: если тик уже
+// наступил, но еще не обработан, учитываем его по флагу PENDSTSET.
+uint32_t micros(void)
+{
+  uint32_t ticks_per_us = SystemCoreClock / 1000000;
+  uint32_t primask = __get_PRIMASK();
+  __disable_irq();
+  uint32_t ms = HAL_GetTick();
+  uint32_t val = SysTick->VAL;
+  if (SCB->ICSR & SCB_ICSR_PENDSTSET_Msk) {
+    val = SysTick->VAL; // Перечитываем после перезагрузки счетчика
+    ms++;
+  }
+  __set_PRIMASK(primask);
+  return ms * 1000 + (SysTick->LOAD - val) / ticks_per_us;
+}
+
+// Прерывание от линии INT MCP2515
+void HAL_GPIO_EXTI_Callback(uint16_t GPIO_Pin)
+{
+  if (GPIO_Pin == MCP_INT_Pin) {
+    MCP2515_IRQ_Handler();
+  }
+}
+
 void print(const char *format, ...) {
   char buffer[128]; // Подберите размер под ваши нужды
   va_list args;
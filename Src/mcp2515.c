@@ -1,9 +1,47 @@
 #include "main.h"
 #include <string.h> // Для memcpy (если будем использовать)
 #include "mcp2515.h"
+#include "mcp2515_filter.h"
+#include "uds.h"
 #include <stdio.h>
 extern SPI_HandleTypeDef hspi1; // Объявляем внешнюю переменную SPI, определенную в main.c
 
+volatile MCP2515_Stats mcp2515_stats;
+
+// Кольцевой буфер принятых кадров: пишет только прерывание (head),
+// читает только основной цикл (tail), поэтому блокировки не нужны.
+static CAN_Frame rx_ring[MCP2515_RX_RING_SIZE];
+static volatile uint16_t rx_ring_head;
+static volatile uint16_t rx_ring_tail;
+
+// Очередь передачи: отдельное кольцо на каждый уровень приоритета
+typedef struct {
+  CAN_Frame frame;
+  uint16_t  timeout_ms;
+  volatile uint32_t *sent_us; // MCP2515_TX_Enqueue_Tracked
+} TX_Entry;
+
+// Состояние аппаратного буфера TXBn
+typedef struct {
+  uint8_t  busy;        // Кадр загружен и ожидает/идет передача
+  uint8_t  aborting;    // TXREQ сброшен по таймауту, ждем освобождения
+  uint8_t  priority;    // TXP загруженного кадра
+  uint16_t timeout_ms;
+  uint32_t start;       // HAL_GetTick() момента RTS
+  volatile uint32_t *sent_us; // Куда отметить уход кадра (NULL - не нужно)
+} TX_Slot;
+
+static TX_Entry tx_queue[MCP2515_TX_PRIO_LEVELS][MCP2515_TX_QUEUE_SIZE];
+static uint8_t tx_head[MCP2515_TX_PRIO_LEVELS];
+static uint8_t tx_count[MCP2515_TX_PRIO_LEVELS];
+static TX_Slot tx_slot[3];
+
+static volatile uint8_t irq_ready;   // Прерывание разрешено после инициализации
+static uint8_t rx_prefer;            // Какой из RXB0/RXB1 читать первым
+static volatile uint8_t lock_depth;  // Вложенность MCP2515_Lock
+static MCP2515_Bit_Timing bit_timing; // Текущий битовый интервал (bitrate == 0 - не выбран)
+static uint8_t obd_extended;         // Адресация OBD запросов: 1 - 29 бит (после Init_ISO27145)
+
 // Определяем команды для MCP2515 согласно datasheet
 #define MCP2515_CMD_READ    0x03
 // Можно добавить другие команды для полноты:
@@ -11,6 +49,86 @@ extern SPI_HandleTypeDef hspi1; // Объявляем внешнюю перем
 // #define MCP2515_CMD_RTS     0x80
 // #define MCP2515_CMD_READ_RX 0x90
 
+/**
+  * @brief  Запрет прерывания INT на время обращения к MCP2515 из основного цикла,
+  *         чтобы транзакция прерывания не вклинилась в середину нашей.
+  */
+static void MCP2515_Lock(void)
+{
+  HAL_NVIC_DisableIRQ(MCP_INT_EXTI_IRQn);
+  lock_depth++;
+}
+
+static void MCP2515_Unlock(void)
+{
+  if (--lock_depth == 0) {
+    HAL_NVIC_EnableIRQ(MCP_INT_EXTI_IRQn);
+  }
+}
+
+/**
+  * @brief  Одна SPI-транзакция с MCP2515: CS в 0, обмен, CS в 1.
+  *         Каждая инструкция MCP2515 должна завершаться подъемом CS,
+  *         поэтому все обращения к контроллеру идут через эту функцию.
+  * @param  tx: Передаваемые байты
+  * @param  rx: Буфер приема (NULL - только передача)
+  * @param  len: Длина транзакции в байтах
+  */
+static void MCP2515_Transfer(uint8_t *tx, uint8_t *rx, uint16_t len)
+{
+  MCP2515_Lock();
+  HAL_GPIO_WritePin(CS__GPIO_Port, CS__Pin, GPIO_PIN_RESET);
+  if (rx != NULL) {
+    HAL_SPI_TransmitReceive(&hspi1, tx, rx, len, HAL_MAX_DELAY);
+  } else {
+    HAL_SPI_Transmit(&hspi1, tx, len, HAL_MAX_DELAY);
+  }
+  HAL_GPIO_WritePin(CS__GPIO_Port, CS__Pin, GPIO_PIN_SET);
+  MCP2515_Unlock();
+}
+
+/**
+  * @brief  Упаковка идентификатора в формат регистров SIDH/SIDL/EID8/EID0.
+  * @param  can_id: 11-битный или 29-битный идентификатор
+  * @param  extended: 1 - расширенный ID (в SIDL выставляется EXIDE)
+  * @param  regs: 4 байта SIDH, SIDL, EID8, EID0
+  */
+static void MCP2515_Encode_ID(uint32_t can_id, uint8_t extended, uint8_t *regs)
+{
+  if (extended) {
+    uint16_t sid = (uint16_t)(can_id >> 18) & 0x7FF; // Биты 28-18
+    uint32_t eid = can_id & 0x3FFFF;                 // Биты 17-0
+    regs[0] = (uint8_t)(sid >> 3);
+    regs[1] = (uint8_t)((sid << 5) | 0x08 | (eid >> 16)); // EXIDE=1, EID17:16
+    regs[2] = (uint8_t)(eid >> 8);
+    regs[3] = (uint8_t)eid;
+  } else {
+    regs[0] = (uint8_t)(can_id >> 3);
+    regs[1] = (uint8_t)(can_id << 5);
+    regs[2] = 0x00;
+    regs[3] = 0x00;
+  }
+}
+
+/**
+  * @brief  Распаковка идентификатора из регистров SIDH/SIDL/EID8/EID0.
+  * @param  regs: 4 байта SIDH, SIDL, EID8, EID0
+  * @param  frame: Кадр, в который записываются id и extended
+  */
+static void MCP2515_Decode_ID(const uint8_t *regs, CAN_Frame *frame)
+{
+  uint32_t sid = ((uint32_t)regs[0] << 3) | (regs[1] >> 5);
+
+  if (regs[1] & 0x08) { // IDE
+    frame->extended = 1;
+    frame->id = (sid << 18) | ((uint32_t)(regs[1] & 0x03) << 16) |
+                ((uint32_t)regs[2] << 8) | regs[3];
+  } else {
+    frame->extended = 0;
+    frame->id = sid;
+  }
+}
+
 /**
   * @brief  Чтение одного регистра MCP2515.
   * @param  reg_addr: Адрес регистра для чтения (например, 0x00 - REG_CANSTAT)
@@ -30,9 +148,7 @@ uint8_t MCP2515_Read_Register(uint8_t reg_addr)
 
   // Выполняем полнодуплексную передачу.
   // HAL_SPI_TransmitReceive блокирующая, работает идеально для такого сценария.
-  HAL_GPIO_WritePin(CS__GPIO_Port, CS__Pin, GPIO_PIN_RESET);
-  HAL_SPI_TransmitReceive(&hspi1, tx_data, rx_data, 3, HAL_MAX_DELAY);
-  HAL_GPIO_WritePin(CS__GPIO_Port, CS__Pin, GPIO_PIN_SET);
+  MCP2515_Transfer(tx_data, rx_data, 3);
 
   // Анализируем принятые данные:
   // rx_data[0] - мусор (принимался, пока мы передавали команду)
@@ -50,9 +166,7 @@ uint8_t MCP2515_Read_Register(uint8_t reg_addr)
 void MCP2515_Write_Register(uint8_t reg_addr,uint8_t reg_data){
   uint8_t pData[3] = {MCP2515_CMD_WRITE,reg_addr, reg_data};
 
-  HAL_GPIO_WritePin(CS__GPIO_Port, CS__Pin, GPIO_PIN_RESET);
-  HAL_SPI_Transmit(&hspi1, pData, 3, HAL_MAX_DELAY);
-  HAL_GPIO_WritePin(CS__GPIO_Port, CS__Pin, GPIO_PIN_SET);
+  MCP2515_Transfer(pData, NULL, 3);
 }
 
 /**
@@ -77,9 +191,7 @@ void MCP2515_Read_Registers(uint8_t start_reg_addr, uint8_t *buffer, uint8_t cou
   }
 
   // Выполняем передачу. Длина = 2 байта (команда+адрес) + количество запрашиваемых байт.
-  HAL_GPIO_WritePin(CS__GPIO_Port, CS__Pin, GPIO_PIN_RESET);
-  HAL_SPI_TransmitReceive(&hspi1, tx_data, rx_data, 2 + count, HAL_MAX_DELAY);
-  HAL_GPIO_WritePin(CS__GPIO_Port, CS__Pin, GPIO_PIN_SET);
+  MCP2515_Transfer(tx_data, rx_data, 2 + count);
   // Копируем полезные данные из приемного буфера в выходной буфер.
   // Первые 2 байта (rx_data[0] и rx_data[1]) - мусор.
   // Последующие 'count' байт - это значения регистров, начиная с start_reg_addr.
@@ -90,28 +202,613 @@ void MCP2515_Read_Registers(uint8_t start_reg_addr, uint8_t *buffer, uint8_t cou
   // }
 }
 
+/**
+  * @brief  Последовательная запись нескольких регистров MCP2515 (одна транзакция).
+  * @param  start_reg_addr: Адрес первого регистра
+  * @param  data: Данные для записи
+  * @param  count: Количество байт
+  */
+void MCP2515_Write_Registers(uint8_t start_reg_addr, const uint8_t *data, uint8_t count)
+{
+  uint8_t tx_data[2 + count];
+
+  tx_data[0] = MCP2515_CMD_WRITE;
+  tx_data[1] = start_reg_addr; // Адрес автоматически инкрементируется MCP2515
+  memcpy(&tx_data[2], data, count);
+
+  MCP2515_Transfer(tx_data, NULL, 2 + count);
+}
+
+/**
+  * @brief  Изменение отдельных битов регистра (BIT MODIFY).
+  * @param  reg_addr: Адрес регистра (только регистры с поддержкой BIT MODIFY)
+  * @param  mask: Маска изменяемых битов
+  * @param  value: Новые значения битов
+  */
+void MCP2515_Bit_Modify(uint8_t reg_addr, uint8_t mask, uint8_t value)
+{
+  uint8_t tx_data[4] = {MCP2515_CMD_BIT_MODIFY, reg_addr, mask, value};
+
+  MCP2515_Transfer(tx_data, NULL, 4);
+}
+
+/**
+  * @brief  Загрузка TX буфера одной транзакцией (LOAD TX BUFFER).
+  *         Инструкция 0x40/0x42/0x44 указывает адрес сразу на TXBnSIDH,
+  *         поэтому ID (4 байта), DLC и данные уходят за один CS-low
+  *         вместо отдельной записи каждого регистра.
+  * @param  txb: Номер буфера 0..2
+  * @param  can_id: Идентификатор (11 или 29 бит)
+  * @param  extended: 0 - стандартный ID, 1 - расширенный (29 бит)
+  * @param  dlc: Длина данных 0..8
+  * @param  data: Данные (может быть NULL при dlc == 0)
+  * @param  send: 1 - сразу запросить отправку (RTS)
+  */
+void MCP2515_Load_TX_Buffer(uint8_t txb, uint32_t can_id, uint8_t extended,
+                            uint8_t dlc, const uint8_t *data, uint8_t send)
+{
+  uint8_t tx_data[1 + 4 + 1 + 8]; // Команда + SIDH..EID0 + DLC + D0..D7
+
+  if (dlc > 8) dlc = 8;
+
+  tx_data[0] = MCP2515_CMD_LOAD_TX_ID(txb);
+  MCP2515_Encode_ID(can_id, extended, &tx_data[1]);
+  tx_data[5] = dlc;
+  if (dlc) memcpy(&tx_data[6], data, dlc);
+
+  // Пишем только нужное количество байт данных
+  MCP2515_Transfer(tx_data, NULL, 6 + dlc);
+
+  // RTS - отдельная инструкция (MCP2515 требует подъема CS между командами),
+  // но это один байт без адреса, поэтому обходится дешевле записи TXBnCTRL.
+  if (send) {
+    MCP2515_Request_To_Send(1u << txb);
+  }
+}
+
+/**
+  * @brief  Запись TX буфера вместе с TXBnCTRL одной транзакцией WRITE:
+  *         TXBnCTRL (приоритет TXP), SIDH..EID0, DLC, данные.
+  *         LOAD TX BUFFER начинается с SIDH, поэтому для установки TXP
+  *         используется последовательная запись с адреса TXBnCTRL.
+  */
+static void MCP2515_Write_TX_Buffer(uint8_t txb, uint8_t priority, const CAN_Frame *frame)
+{
+  uint8_t tx_data[2 + 1 + 4 + 1 + 8];
+  uint8_t dlc = frame->dlc > 8 ? 8 : frame->dlc;
+
+  tx_data[0] = MCP2515_CMD_WRITE;
+  tx_data[1] = MCP2515_REG_TXB0CTRL + 0x10 * txb;
+  tx_data[2] = priority & MCP2515_TXB_TXP_MASK; // TXREQ = 0, запрос - отдельным RTS
+  MCP2515_Encode_ID(frame->id, frame->extended, &tx_data[3]);
+  tx_data[7] = dlc | (frame->rtr ? 0x40 : 0x00);
+  memcpy(&tx_data[8], frame->data, dlc);
+
+  MCP2515_Transfer(tx_data, NULL, 8 + dlc);
+}
+
+/**
+  * @brief  Запрос отправки (RTS) для буферов по маске (бит 0 - TXB0 ... бит 2 - TXB2).
+  */
+void MCP2515_Request_To_Send(uint8_t txb_mask)
+{
+  uint8_t rts_cmd = MCP2515_CMD_RTS | (txb_mask & 0x07);
+  MCP2515_Transfer(&rts_cmd, NULL, 1);
+}
+
+/**
+  * @brief  Отправка кадра через очередь передачи (приоритет и таймаут по умолчанию):
+  *         кадр ставится в очередь, в свободные TXB0..TXB2 его грузит MCP2515_TX_Service.
+  * @retval 1 - кадр в очереди, 0 - очередь переполнена
+  */
+uint8_t MCP2515_Send_Frame(uint32_t can_id, uint8_t extended, uint8_t dlc, const uint8_t *data)
+{
+  CAN_Frame frame = {0};
+
+  frame.id = can_id;
+  frame.extended = extended;
+  frame.dlc = dlc > 8 ? 8 : dlc;
+  if (frame.dlc) memcpy(frame.data, data, frame.dlc);
+  return MCP2515_TX_Enqueue(&frame, MCP2515_TX_PRIO_DEFAULT, MCP2515_TX_TIMEOUT_DEFAULT);
+}
+
+/**
+  * @brief  Постановка кадра в очередь передачи (без ожидания).
+  *         Кадры раздаются в TXB0..TXB2 с приоритетом TXP = priority.
+  *         Кадры одного приоритета уходят строго в порядке постановки.
+  * @param  frame: Кадр для передачи
+  * @param  priority: 0 (низший) .. 3 (высший)
+  * @param  timeout_ms: Время ожидания арбитража, после которого кадр отменяется
+  * @retval 1 - кадр в очереди, 0 - очередь переполнена
+  */
+uint8_t MCP2515_TX_Enqueue(const CAN_Frame *frame, uint8_t priority, uint16_t timeout_ms)
+{
+  return MCP2515_TX_Enqueue_Tracked(frame, priority, timeout_ms, NULL);
+}
+
+/**
+  * @brief  Постановка кадра в очередь с отметкой ухода: когда буфер MCP2515
+  *         освободится (кадр передан или отменен), в *sent_us пишется micros() | 1.
+  * @retval 1 - кадр в очереди, 0 - очередь переполнена (*sent_us не тронут)
+  */
+uint8_t MCP2515_TX_Enqueue_Tracked(const CAN_Frame *frame, uint8_t priority, uint16_t timeout_ms,
+                                   volatile uint32_t *sent_us)
+{
+  uint8_t result = 0;
+
+  priority &= MCP2515_TXB_TXP_MASK;
+
+  MCP2515_Lock();
+  if (tx_count[priority] < MCP2515_TX_QUEUE_SIZE) {
+    uint8_t idx = (tx_head[priority] + tx_count[priority]) % MCP2515_TX_QUEUE_SIZE;
+    tx_queue[priority][idx].frame = *frame;
+    tx_queue[priority][idx].timeout_ms = timeout_ms;
+    tx_queue[priority][idx].sent_us = sent_us;
+    tx_count[priority]++;
+    result = 1;
+  } else {
+    mcp2515_stats.tx_queue_full++;
+  }
+  MCP2515_Unlock();
+
+  // Сразу пробуем загрузить свободный буфер
+  MCP2515_TX_Service();
+  return result;
+}
+
+/**
+  * @brief  Обработка передачи по байту READ STATUS.
+  *         Буфер свободен, когда TXREQ сброшен (кадр ушел или отменен).
+  *         Кадры одного приоритета не загружаются параллельно: при равных TXP
+  *         MCP2515 первым отправляет буфер с большим номером, и порядок
+  *         (например, Consecutive Frame ISO-TP) нарушился бы.
+  */
+static void MCP2515_TX_Process(uint8_t status)
+{
+  static const uint8_t txreq_bit[3] = {MCP2515_STATUS_TX0REQ, MCP2515_STATUS_TX1REQ, MCP2515_STATUS_TX2REQ};
+  static const uint8_t txif_bit[3] = {MCP2515_STATUS_TX0IF, MCP2515_STATUS_TX1IF, MCP2515_STATUS_TX2IF};
+  uint8_t clear_intf = 0;
+  uint8_t rts_mask = 0;
+  uint8_t prio_busy = 0;
+  uint32_t now = HAL_GetTick();
+
+  for (uint8_t n = 0; n < 3; n++) {
+    TX_Slot *slot = &tx_slot[n];
+
+    if (status & txif_bit[n]) clear_intf |= (MCP2515_INT_TX0I << n);
+    if (!slot->busy) continue;
+
+    if (!(status & txreq_bit[n])) {
+      // Передача завершена или отменена
+      if (!slot->aborting) mcp2515_stats.tx_frames++;
+      if (slot->sent_us) *slot->sent_us = micros() | 1;
+      slot->busy = 0;
+      slot->aborting = 0;
+    } else if (!slot->aborting && (now - slot->start) >= slot->timeout_ms) {
+      // Кадр не выиграл арбитраж / нет ACK за отведенное время - отменяем
+      MCP2515_Bit_Modify(MCP2515_REG_TXB0CTRL + 0x10 * n, MCP2515_TXB_TXREQ, 0x00);
+      slot->aborting = 1;
+      mcp2515_stats.tx_timeouts++;
+    }
+    if (slot->busy) prio_busy |= 1u << slot->priority;
+  }
+
+  if (clear_intf) {
+    MCP2515_Bit_Modify(MCP2515_REG_CANINTF, clear_intf, 0x00);
+  }
+
+  // Загрузка свободных буферов, начиная с высшего приоритета
+  for (uint8_t n = 0; n < 3; n++) {
+    if (tx_slot[n].busy) continue;
+
+    for (int8_t prio = MCP2515_TX_PRIO_LEVELS - 1; prio >= 0; prio--) {
+      if (!tx_count[prio] || (prio_busy & (1u << prio))) continue;
+
+      TX_Entry *entry = &tx_queue[prio][tx_head[prio]];
+      MCP2515_Write_TX_Buffer(n, prio, &entry->frame);
+      tx_slot[n].busy = 1;
+      tx_slot[n].aborting = 0;
+      tx_slot[n].priority = prio;
+      tx_slot[n].timeout_ms = entry->timeout_ms;
+      tx_slot[n].start = now;
+      tx_slot[n].sent_us = entry->sent_us;
+      tx_head[prio] = (tx_head[prio] + 1) % MCP2515_TX_QUEUE_SIZE;
+      tx_count[prio]--;
+      prio_busy |= 1u << prio;
+      rts_mask |= 1u << n;
+      break;
+    }
+  }
+
+  // Один RTS на все загруженные буферы
+  if (rts_mask) {
+    MCP2515_Request_To_Send(rts_mask);
+  }
+}
+
+/**
+  * @brief  Обслуживание передачи: завершение отправленных кадров (TXREQ/TXnIF),
+  *         отмена по таймауту, загрузка свободных буферов из очереди.
+  *         Вызывается из основного цикла и из прерывания по TXnIF.
+  */
+void MCP2515_TX_Service(void)
+{
+  MCP2515_Lock();
+  MCP2515_TX_Process(MCP2515_Read_Status());
+  MCP2515_Unlock();
+}
+
+/**
+  * @brief  Отмена всех передач (ABAT) и очистка очереди.
+  */
+void MCP2515_TX_Abort_All(void)
+{
+  uint32_t start = HAL_GetTick();
+
+  MCP2515_Lock();
+  MCP2515_Bit_Modify(MCP2515_REG_CANCTRL, MCP2515_CANCTRL_ABAT, MCP2515_CANCTRL_ABAT);
+  // Кадр, уже идущий по шине, дописывается до конца - ждем сброса всех TXREQ
+  while ((MCP2515_Read_Status() & (MCP2515_STATUS_TX0REQ | MCP2515_STATUS_TX1REQ | MCP2515_STATUS_TX2REQ)) &&
+         (HAL_GetTick() - start) < 5) {
+  }
+  MCP2515_Bit_Modify(MCP2515_REG_CANCTRL, MCP2515_CANCTRL_ABAT, 0x00);
+  MCP2515_Bit_Modify(MCP2515_REG_CANINTF, MCP2515_INT_TX0I | MCP2515_INT_TX1I | MCP2515_INT_TX2I, 0x00);
+
+  // Отмененные кадры тоже "ушли": ждущие отметки не должны висеть
+  uint32_t now_us = micros() | 1;
+  for (uint8_t n = 0; n < 3; n++) {
+    if (tx_slot[n].busy && tx_slot[n].sent_us) *tx_slot[n].sent_us = now_us;
+  }
+  for (uint8_t prio = 0; prio < MCP2515_TX_PRIO_LEVELS; prio++) {
+    for (uint8_t i = 0; i < tx_count[prio]; i++) {
+      TX_Entry *entry = &tx_queue[prio][(tx_head[prio] + i) % MCP2515_TX_QUEUE_SIZE];
+      if (entry->sent_us) *entry->sent_us = now_us;
+    }
+  }
+  memset(tx_slot, 0, sizeof(tx_slot));
+  memset(tx_count, 0, sizeof(tx_count));
+  MCP2515_Unlock();
+}
+
+/**
+  * @brief  Количество кадров в очереди и в буферах MCP2515.
+  */
+uint8_t MCP2515_TX_Pending(void)
+{
+  uint8_t pending = 0;
+
+  for (uint8_t prio = 0; prio < MCP2515_TX_PRIO_LEVELS; prio++) pending += tx_count[prio];
+  for (uint8_t n = 0; n < 3; n++) pending += tx_slot[n].busy;
+  return pending;
+}
+
+/**
+  * @brief  Чтение статуса командой READ STATUS (флаги RXnIF/TXnIF, TXREQ).
+  * @retval Байт статуса (биты MCP2515_STATUS_*)
+  */
+uint8_t MCP2515_Read_Status(void)
+{
+  uint8_t tx_data[2] = {MCP2515_CMD_READ_STATUS, 0x00};
+  uint8_t rx_data[2];
+
+  MCP2515_Transfer(tx_data, rx_data, 2);
+  return rx_data[1];
+}
+
+/**
+  * @brief  Чтение приемного буфера одной транзакцией (READ RX BUFFER).
+  *         ID, DLC и данные читаются за один CS-low, флаг RXnIF
+  *         сбрасывается контроллером автоматически при подъеме CS.
+  * @param  rxb: Номер буфера 0 или 1
+  * @param  frame: Принятый кадр
+  */
+void MCP2515_Read_RX_Buffer(uint8_t rxb, CAN_Frame *frame)
+{
+  // Команда + SIDH, SIDL, EID8, EID0, DLC + D0..D7
+  uint8_t tx_data[1 + 13] = {0};
+  uint8_t rx_data[1 + 13];
+
+  tx_data[0] = rxb ? MCP2515_CMD_READ_RX1 : MCP2515_CMD_READ_RX0;
+  MCP2515_Transfer(tx_data, rx_data, sizeof(tx_data));
+
+  MCP2515_Decode_ID(&rx_data[1], frame);
+  // RTR: для стандартного кадра - бит SRR в SIDL, для расширенного - бит RTR в DLC
+  frame->rtr = frame->extended ? ((rx_data[5] >> 6) & 0x01) : ((rx_data[2] >> 4) & 0x01);
+  frame->dlc = rx_data[5] & 0x0F;
+  if (frame->dlc > 8) frame->dlc = 8;
+  memcpy(frame->data, &rx_data[6], 8);
+}
+
+/**
+  * @brief  Выбор буфера для чтения так, чтобы кадры шли в порядке прихода.
+  *         С BUKT кадр попадает в RXB1 только пока RXB0 занят, поэтому при
+  *         двух полных буферах после чтения одного более старый кадр лежит в
+  *         другом - предпочтение чередуется. Был полон один буфер - после его
+  *         чтения оба свободны, следующий кадр придет в RXB0 и он старше.
+  * @param  status: Результат READ STATUS
+  * @retval Номер буфера 0/1
+  */
+static uint8_t MCP2515_Next_RX_Buffer(uint8_t status)
+{
+  uint8_t both = (status & MCP2515_STATUS_RX0IF) && (status & MCP2515_STATUS_RX1IF);
+  uint8_t rxb;
+
+  if (both) {
+    rxb = rx_prefer;
+  } else {
+    rxb = (status & MCP2515_STATUS_RX0IF) ? 0 : 1;
+  }
+  rx_prefer = both ? rxb ^ 1 : 0;
+  return rxb;
+}
+
+/**
+  * @brief  Обработка флагов ошибок: подсчет переполнений RXB0/RXB1 (EFLG)
+  *         и ошибок сообщений (MERRF), сброс флагов.
+  * @retval 1 - был сброшен хотя бы один флаг
+  */
+static uint8_t MCP2515_Service_Errors(void)
+{
+  uint8_t intf = MCP2515_Read_Register(MCP2515_REG_CANINTF);
+  uint8_t handled = 0;
+
+  if (intf & MCP2515_INT_ERRI) {
+    uint8_t eflg = MCP2515_Read_Register(MCP2515_REG_EFLG);
+    if (eflg & MCP2515_EFLG_RX0OVR) mcp2515_stats.rx_overflow[0]++;
+    if (eflg & MCP2515_EFLG_RX1OVR) mcp2515_stats.rx_overflow[1]++;
+    // Биты RXnOVR сбрасываются только программно
+    MCP2515_Bit_Modify(MCP2515_REG_EFLG, MCP2515_EFLG_RX0OVR | MCP2515_EFLG_RX1OVR, 0x00);
+    MCP2515_Bit_Modify(MCP2515_REG_CANINTF, MCP2515_INT_ERRI, 0x00);
+    handled = 1;
+  }
+  if (intf & MCP2515_INT_MERRF) {
+    mcp2515_stats.msg_errors++;
+    MCP2515_Bit_Modify(MCP2515_REG_CANINTF, MCP2515_INT_MERRF, 0x00);
+    handled = 1;
+  }
+  return handled;
+}
+
+/**
+  * @brief  Прием кадра без ожидания: READ STATUS + READ RX BUFFER.
+  *         Буферы RXB0/RXB1 обслуживаются в порядке прихода кадров.
+  * @param  frame: Принятый кадр
+  * @retval 1 - кадр принят, 0 - буферы пусты
+  */
+uint8_t MCP2515_Receive_Frame(CAN_Frame *frame)
+{
+  uint8_t result = 0;
+
+  MCP2515_Lock(); // Статус и буфер читаем без вмешательства прерывания
+  uint8_t status = MCP2515_Read_Status();
+
+  if (status & (MCP2515_STATUS_RX0IF | MCP2515_STATUS_RX1IF)) {
+    frame->timestamp = micros();
+    MCP2515_Read_RX_Buffer(MCP2515_Next_RX_Buffer(status), frame);
+    result = 1;
+  }
+  MCP2515_Unlock();
+  return result;
+}
+
+/**
+  * @brief  Обработчик прерывания по линии INT (вызывается из HAL_GPIO_EXTI_Callback).
+  *         Вычитывает RXB0/RXB1 в кольцевой буфер с отметкой времени.
+  */
+void MCP2515_IRQ_Handler(void)
+{
+  uint8_t status;
+
+  if (!irq_ready) return;
+
+  // INT активен низким уровнем, а EXTI ловит только фронт: если во время
+  // чтения пришел новый кадр, INT не поднимется, поэтому читаем до опустошения.
+  for (;;) {
+    status = MCP2515_Read_Status();
+    if (status & (MCP2515_STATUS_TX0IF | MCP2515_STATUS_TX1IF | MCP2515_STATUS_TX2IF)) {
+      // Буфер передачи освободился - сразу загружаем следующий кадр из очереди
+      MCP2515_TX_Process(status);
+    }
+    if (!(status & (MCP2515_STATUS_RX0IF | MCP2515_STATUS_RX1IF))) {
+      // После обработки TX перечитываем статус: за это время мог прийти кадр
+      if (status & (MCP2515_STATUS_TX0IF | MCP2515_STATUS_TX1IF | MCP2515_STATUS_TX2IF)) {
+        continue;
+      }
+      // RX пусты, но INT в нуле - остались флаги ошибок/переполнения
+      if (HAL_GPIO_ReadPin(MCP_INT_GPIO_Port, MCP_INT_Pin) == GPIO_PIN_RESET &&
+          MCP2515_Service_Errors()) {
+        continue;
+      }
+      break;
+    }
+
+    uint16_t head = rx_ring_head;
+    uint16_t next = (head + 1) & (MCP2515_RX_RING_SIZE - 1);
+    CAN_Frame *frame = &rx_ring[head];
+
+    if (next == rx_ring_tail) {
+      // Кольцо заполнено: кадр все равно вычитываем, чтобы освободить буфер MCP2515
+      static CAN_Frame dropped;
+      frame = &dropped;
+      mcp2515_stats.rx_ring_drops++;
+    }
+
+    frame->timestamp = micros();
+    MCP2515_Read_RX_Buffer(MCP2515_Next_RX_Buffer(status), frame);
+    mcp2515_stats.rx_frames++;
+
+    if (frame != &rx_ring[head]) continue;
+    __DMB(); // Кадр полностью записан до публикации head
+    rx_ring_head = next;
+  }
+}
+
+/**
+  * @brief  Извлечение кадра из кольцевого буфера приема (без ожидания).
+  * @param  frame: Принятый кадр
+  * @retval 1 - кадр извлечен, 0 - буфер пуст
+  */
+uint8_t MCP2515_RX_Pop(CAN_Frame *frame)
+{
+  uint16_t tail = rx_ring_tail;
+
+  if (tail == rx_ring_head) return 0;
+
+  __DMB();
+  *frame = rx_ring[tail];
+  __DMB(); // Копия сделана до освобождения ячейки
+  rx_ring_tail = (tail + 1) & (MCP2515_RX_RING_SIZE - 1);
+  return 1;
+}
+
+/**
+  * @brief  Количество кадров, ожидающих в кольцевом буфере приема.
+  */
+uint16_t MCP2515_RX_Available(void)
+{
+  return (rx_ring_head - rx_ring_tail) & (MCP2515_RX_RING_SIZE - 1);
+}
+
+/**
+  * @brief  Настройка обоих приемных буферов: RXB0 с rollover в RXB1.
+  * @param  rxm: Режим приема MCP2515_RXB_RXM_*
+  */
+static void MCP2515_Config_RX_Buffers(uint8_t rxm)
+{
+  MCP2515_Write_Register(MCP2515_REG_RXB0CTRL, rxm | MCP2515_RXB0_BUKT);
+  MCP2515_Write_Register(MCP2515_REG_RXB1CTRL, rxm);
+}
+
+/**
+  * @brief  Разрешение прерываний приема RX0IE/RX1IE на выводе INT.
+  *         Вызывается в конце инициализации.
+  */
+static void MCP2515_Enable_RX_IRQ(void)
+{
+  MCP2515_Write_Register(MCP2515_REG_EFLG, 0x00);    // Сброс RX0OVR/RX1OVR
+  MCP2515_Write_Register(MCP2515_REG_CANINTF, 0x00); // Сброс старых флагов
+  rx_prefer = 0;
+  MCP2515_Write_Register(MCP2515_REG_CANINTE, MCP2515_INT_RX0I | MCP2515_INT_RX1I | MCP2515_INT_ERRI |
+                                              MCP2515_INT_TX0I | MCP2515_INT_TX1I | MCP2515_INT_TX2I);
+  irq_ready = 1;
+
+  // Если INT уже в нуле (кадр пришел до разрешения), фронта не будет - вызываем вручную
+  if (HAL_GPIO_ReadPin(MCP_INT_GPIO_Port, MCP_INT_Pin) == GPIO_PIN_RESET) {
+    HAL_NVIC_SetPendingIRQ(MCP_INT_EXTI_IRQn);
+  }
+}
+
+/**
+  * @brief  Запрет прерываний MCP2515 (перед переходом в режим конфигурации).
+  */
+static void MCP2515_Disable_IRQ(void)
+{
+  irq_ready = 0;
+  MCP2515_Write_Register(MCP2515_REG_CANINTE, 0x00);
+  // Переход в режим конфигурации отменяет передачи - сбрасываем состояние очереди
+  memset(tx_slot, 0, sizeof(tx_slot));
+  memset(tx_count, 0, sizeof(tx_count));
+}
+
+/**
+  * @brief  Запись CNF3, CNF2, CNF1 одной транзакцией (только в режиме конфигурации).
+  */
+static void MCP2515_Write_CNF(const MCP2515_Bit_Timing *timing)
+{
+  uint8_t cnf[3] = {timing->cnf3, timing->cnf2, timing->cnf1};
+  MCP2515_Write_Registers(MCP2515_REG_CNF3, cnf, 3);
+}
+
+/**
+  * @brief  Запись текущего битового интервала (только в режиме конфигурации).
+  *         Если скорость не выбрана, берется MCP2515_BITRATE_DEFAULT.
+  */
+static void MCP2515_Write_Bit_Timing(void)
+{
+  if (bit_timing.bitrate == 0) {
+    MCP2515_Get_Bit_Timing(MCP2515_OSC_HZ, MCP2515_BITRATE_DEFAULT, &bit_timing);
+  }
+  MCP2515_Write_CNF(&bit_timing);
+}
+
+/**
+  * @brief  Выбор скорости шины без пересборки прошивки
+  */
+uint8_t MCP2515_Set_Bitrate(uint32_t bitrate)
+{
+  MCP2515_Bit_Timing timing;
+
+  if (!MCP2515_Get_Bit_Timing(MCP2515_OSC_HZ, bitrate, &timing)) return 0;
+  bit_timing = timing;
+
+  // Контроллер уже работает - переписываем CNF и возвращаемся в прежний режим
+  if (irq_ready) {
+    uint8_t canctrl = MCP2515_Read_Register(MCP2515_REG_CANCTRL);
+    MCP2515_Disable_IRQ();
+    MCP2515_Write_Register(MCP2515_REG_CANCTRL, 0x80);
+    HAL_Delay(10);
+    MCP2515_Write_Bit_Timing();
+    MCP2515_Write_Register(MCP2515_REG_CANCTRL, canctrl);
+    HAL_Delay(10);
+    MCP2515_Enable_RX_IRQ();
+  }
+  return 1;
+}
+
+/**
+  * @brief  Текущая скорость шины, бит/с
+  */
+uint32_t MCP2515_Get_Bitrate(void)
+{
+  return bit_timing.bitrate ? bit_timing.bitrate : MCP2515_BITRATE_DEFAULT;
+}
+
 /*
-  *         Без использования прерываний (режим опроса).
+  *         Прием по прерыванию INT: RXB0/RXB1 вычитываются в кольцевой буфер.
   */
 void MCP2515_Init_ISO15765(void) {
   // 1. Переход в режим конфигурации
+  MCP2515_Disable_IRQ();
   MCP2515_Write_Register(MCP2515_REG_CANCTRL, 0x80); // Режим конфигурации
   HAL_Delay(10);
 
-  // 2. Настройка битрейта 500 kbps для кварца 8 МГц
-  MCP2515_Write_Register(MCP2515_REG_CNF1, 0x00); // SJW=1, BRP=0
-  MCP2515_Write_Register(MCP2515_REG_CNF2, 0xD0); // BTLMODE=1, SAM=0, PS1=6 Tq
-  MCP2515_Write_Register(MCP2515_REG_CNF3, 0x02); // PS2=3 Tq
-
-  // 3. !!! НАСТРОЙКА ПРЕРЫВАНИЙ ПРОПУСКАЕТСЯ !!!
-  // MCP2515_Write_Register(MCP2515_REG_CANINTE, 0x01); // ЭТУ СТРОКУ УБИРАЕМ
+  // 2. Битовый интервал (MCP2515_Set_Bitrate, по умолчанию 500 kbps)
+  MCP2515_Write_Bit_Timing();
 
-  // 4. Настройка буфера приема RXB0
-  MCP2515_Write_Register(MCP2515_REG_RXB0CTRL, 0x00); // Принимать все сообщения
+  // 3. Настройка буферов приема RXB0 + RXB1 (rollover)
+  MCP2515_Config_RX_Buffers(MCP2515_RXB_RXM_ANY); // Принимать все сообщения
+  obd_extended = 0;
 
-  // 5. Возврат в нормальный режим
+  // 4. Возврат в нормальный режим
   MCP2515_Write_Register(MCP2515_REG_CANCTRL, 0x00); // Нормальный режим
   HAL_Delay(10);
+
+  // 5. Прерывания приема на INT
+  MCP2515_Enable_RX_IRQ();
+}
+
+/**
+  * @brief  Пассивный прием всех кадров (режим сниффера)
+  */
+void MCP2515_Init_Listen_Only(void) {
+  // 1. Режим конфигурации
+  MCP2515_Disable_IRQ();
+  MCP2515_Write_Register(MCP2515_REG_CANCTRL, MCP2515_MODE_CONFIG);
+  HAL_Delay(10);
+
+  // 2. Битовый интервал (MCP2515_Set_Bitrate, по умолчанию 500 kbps)
+  MCP2515_Write_Bit_Timing();
+
+  // 3. Фильтры открыты: RXB0 + RXB1 (rollover) принимают все кадры
+  MCP2515_Config_RX_Buffers(MCP2515_RXB_RXM_ANY);
+
+  // 4. Только прием: без ACK и кадров ошибки, шина не нагружается
+  MCP2515_Write_Register(MCP2515_REG_CANCTRL, MCP2515_MODE_LISTEN);
+  HAL_Delay(10);
+
+  // 5. Прерывания приема и ошибок сообщений (MERRF) на INT
+  MCP2515_Enable_RX_IRQ();
+  MCP2515_Bit_Modify(MCP2515_REG_CANINTE, MCP2515_INT_MERRF, MCP2515_INT_MERRF);
 }
 
 /*
@@ -119,100 +816,223 @@ void MCP2515_Init_ISO15765(void) {
   * 29-битные идентификаторы, фильтрация на ответы ECU
   */
 void MCP2515_Init_ISO27145(void) {
+  // Ответы всех ECU тестеру 0xF1: 0x18DAF1xx (xx - адрес ECU)
+  static const CAN_Filter_Range ranges[] = {
+    {0x18DAF100, 0x18DAF1FF, 1},
+  };
+  MCP2515_Init_Filtered(ranges, sizeof(ranges) / sizeof(ranges[0]), NULL);
+  obd_extended = 1;
+}
+
+/**
+  * @brief  Отправка через TXB0 (самый простой вариант)
+  */
+void MCP2515_Send_ISO27145_TXB0_Extended(uint32_t can_id, uint8_t *data, uint8_t length) {
+  // Кадр с EXIDE через очередь передачи (TXB0..TXB2)
+  MCP2515_Send_Frame(can_id, 1, length, data);
+}
+
+/**
+  * @brief  Инициализация MCP2515 с фильтром на OBD ответы
+  */
+void MCP2515_Init_With_Filter(void) {
+  // Физические ответы ECU на 11-битные OBD запросы: 0x7E8-0x7EF
+  static const CAN_Filter_Range ranges[] = {
+    {0x7E8, 0x7EF, 0},
+  };
+  MCP2515_Init_Filtered(ranges, sizeof(ranges) / sizeof(ranges[0]), NULL);
+  obd_extended = 0;
+}
+
+/**
+  * @brief  Инициализация с аппаратными фильтрами, подобранными под набор ID
+  */
+uint8_t MCP2515_Init_Filtered(const CAN_Filter_Range *ranges, uint8_t count, MCP2515_Filter_Config *report) {
+  MCP2515_Filter_Config cfg;
+
+  if (!MCP2515_Filter_Solve(ranges, count, &cfg)) return 0;
+  if (report) *report = cfg;
+
   // 1. Режим конфигурации
+  MCP2515_Disable_IRQ();
   MCP2515_Write_Register(MCP2515_REG_CANCTRL, 0x80);
   HAL_Delay(10);
 
-  // 2. Настройка битрейта
-  MCP2515_Write_Register(MCP2515_REG_CNF1, 0x00);
-  MCP2515_Write_Register(MCP2515_REG_CNF2, 0xD0);
-  MCP2515_Write_Register(MCP2515_REG_CNF3, 0x02);
-
-  // 3. НАСТРОЙКА ФИЛЬТРА RXF0 на прием 0x18DAF100
-  MCP2515_Write_Register(MCP2515_REG_RXF0SIDH, (uint8_t)(0x18DAF100 >> 21));
-  MCP2515_Write_Register(MCP2515_REG_RXF0SIDL, (uint8_t)(0x18DAF100 >> 13));
-  MCP2515_Write_Register(MCP2515_REG_RXF0EID8, (uint8_t)(0x18DAF100 >> 5));
-  MCP2515_Write_Register(MCP2515_REG_RXF0EID0, (uint8_t)(0x18DAF100 << 3));
+  // 2. Битовый интервал (MCP2515_Set_Bitrate, по умолчанию 500 kbps)
+  MCP2515_Write_Bit_Timing();
 
-  // 4. НАСТРОЙКА МАСКИ RXM0 (проверять все биты)
-  MCP2515_Write_Register(MCP2515_REG_RXM0SIDH, 0xFF); // Все биты SIDH
-  MCP2515_Write_Register(MCP2515_REG_RXM0SIDL, 0xE3); // Все биты SIDL + EID
-  MCP2515_Write_Register(MCP2515_REG_RXM0EID8, 0xFF); // Все биты EID8
-  MCP2515_Write_Register(MCP2515_REG_RXM0EID0, 0xFF); // Все биты EID0
+  // 3. Маски и фильтры за один проход (три последовательных WRITE)
+  MCP2515_Filter_Apply(&cfg);
 
-  // 5. Настройка буфера RXB0 на использование фильтра 0
-  MCP2515_Write_Register(MCP2515_REG_RXB0CTRL, 0x20); // Использовать фильтры
+  // 4. Буферы RXB0 + RXB1 (rollover) принимают только прошедшие фильтр кадры
+  MCP2515_Config_RX_Buffers(MCP2515_RXB_RXM_FILTER);
 
-  // 6. Включение Extended ID режима
-  uint8_t rxctrl = MCP2515_Read_Register(MCP2515_REG_RXB0CTRL);
-  MCP2515_Write_Register(MCP2515_REG_RXB0CTRL, rxctrl | 0x08); // EXIDEN=1
-
-  // 7. Возврат в нормальный режим
+  // 5. Возврат в нормальный режим
   MCP2515_Write_Register(MCP2515_REG_CANCTRL, 0x00);
   HAL_Delay(10);
+
+  // 6. Прерывания приема на INT
+  MCP2515_Enable_RX_IRQ();
+  return 1;
 }
 
 /**
-  * @brief  Отправка через TXB0 (самый простой вариант)
+  * @brief  Смена режима с ожиданием подтверждения в CANSTAT (вместо HAL_Delay).
+  * @retval 1 - режим установлен, 0 - таймаут
   */
-void MCP2515_Send_ISO27145_TXB0_Extended(uint32_t can_id, uint8_t *data, uint8_t length) {
-  // Запись ID и данных
-  MCP2515_Write_Register(MCP2515_REG_TXB0SIDH, (uint8_t)(can_id >> 21));
-  MCP2515_Write_Register(MCP2515_REG_TXB0SIDL, (uint8_t)(can_id >> 13));
-  MCP2515_Write_Register(MCP2515_REG_TXB0EID8, (uint8_t)(can_id >> 5));
-  MCP2515_Write_Register(MCP2515_REG_TXB0EID0, (uint8_t)(can_id << 3));
-  
-  // Установка EXIDE бита
-  uint8_t sidl = MCP2515_Read_Register(MCP2515_REG_TXB0SIDL);
-  MCP2515_Write_Register(MCP2515_REG_TXB0SIDL, sidl | 0x08);
-  
-  // Данные
-  MCP2515_Write_Register(MCP2515_REG_TXB0DLC, length);
-  for (int i = 0; i < length; i++) {
-    MCP2515_Write_Register(MCP2515_REG_TXB0D0 + i, data[i]);
+static uint8_t MCP2515_Set_Mode(uint8_t mode)
+{
+  uint32_t start = HAL_GetTick();
+
+  MCP2515_Bit_Modify(MCP2515_REG_CANCTRL, MCP2515_MODE_MASK, mode);
+  while ((MCP2515_Read_Register(MCP2515_REG_CANSTAT) & MCP2515_MODE_MASK) != mode) {
+    if ((HAL_GetTick() - start) > 2) return 0;
   }
-  
-  // RTS для TXB0
-  uint8_t rts_cmd = MCP2515_CMD_RTS_TX0;
-  HAL_GPIO_WritePin(CS__GPIO_Port, CS__Pin, GPIO_PIN_RESET);
-  HAL_SPI_Transmit(&hspi1, &rts_cmd, 1, HAL_MAX_DELAY);
-  HAL_GPIO_WritePin(CS__GPIO_Port, CS__Pin, GPIO_PIN_SET);
+  return 1;
 }
 
-// Отправка ISO 27145 запроса
-void Send_WWH_OBD_Request(void) {
-  uint8_t uds_data[] = {0x02, 0x10, 0x85, 0x0C, 0x00}; // UDS запрос RPM
-  MCP2515_Send_ISO27145_TXB0_Extended(0x18DB33F1, uds_data, 5);
+/**
+  * @brief  Перенастройка на скорость timing и переход в режим mode,
+  *         прием всех кадров в оба буфера, флаги сброшены.
+  */
+static uint8_t MCP2515_Detect_Setup(const MCP2515_Bit_Timing *timing, uint8_t mode)
+{
+  if (!MCP2515_Set_Mode(MCP2515_MODE_CONFIG)) return 0;
+  MCP2515_Write_CNF(timing);
+  MCP2515_Config_RX_Buffers(MCP2515_RXB_RXM_ANY);
+  MCP2515_Write_Register(MCP2515_REG_EFLG, 0x00);
+  MCP2515_Write_Register(MCP2515_REG_CANINTF, 0x00);
+  return MCP2515_Set_Mode(mode);
 }
 
 /**
-  * @brief  Инициализация MCP2515 с фильтром на OBD ответы
+  * @brief  Ответ ECU на запрос OBD по 11- или 29-битной адресации ISO 15765-4
   */
-void MCP2515_Init_With_Filter(void) {
-  // 1. Переход в режим конфигурации (для настройки фильтров)
-  MCP2515_Write_Register(MCP2515_REG_CANCTRL, 0x80);
-  HAL_Delay(10);
+static uint8_t MCP2515_Is_OBD_Response(const CAN_Frame *frame, uint8_t extended)
+{
+  if (frame->extended != extended) return 0;
+  if (extended) return (frame->id & 0xFFFFFF00) == CAN_ISO27145_RESPONSE_ID;
+  return frame->id >= CAN_OBD_RESPONSE_ID && frame->id <= CAN_OBD_RESPONSE_ID + 7;
+}
 
-  // 2. Настройка битрейта (как ранее)...
-  MCP2515_Write_Register(MCP2515_REG_CNF1, 0x00);
-  MCP2515_Write_Register(MCP2515_REG_CNF2, 0xD0);
-  MCP2515_Write_Register(MCP2515_REG_CNF3, 0x02);
+/**
+  * @brief  Прослушивание (listen-only) на одной скорости: подсчет правильных
+  *         кадров и ошибок MERRF. Прием опросом, прерывание INT запрещено.
+  * @param  votes: Голоса за 29-битные (>0) или 11-битные (<0) ответы ECU
+  */
+static void MCP2515_Detect_Listen(const MCP2515_Bit_Timing *timing, uint16_t *frames,
+                                  uint16_t *errors, int16_t *votes)
+{
+  uint32_t start = HAL_GetTick();
+  CAN_Frame frame;
 
-  // 3. НАСТРОЙКА ФИЛЬТРА RXF0 на прием ID = 0x7E8
-  // Для 11-битного ID: биты 10-3 в SIDH, биты 2-0 в SIDL
-  MCP2515_Write_Register(0x00, (uint8_t)(0x7E8 >> 3)); // RXF0SIDH: старшие биты ID
-  MCP2515_Write_Register(0x01, (uint8_t)(0x7E8 << 5)); // RXF0SIDL: младшие биты ID
+  *frames = 0;
+  *errors = 0;
+  if (!MCP2515_Detect_Setup(timing, MCP2515_MODE_LISTEN)) return;
 
-  // 4. Настройка маски для RXF0 (проверять все биты ID)
-  MCP2515_Write_Register(0x20, 0xFF); // RXM0SIDH: маска = 1 (проверять)
-  MCP2515_Write_Register(0x21, 0xE0); // RXM0SIDL: маска = 1 для бит 2-0
+  while ((HAL_GetTick() - start) < MCP2515_DETECT_WINDOW_MS) {
+    uint8_t status = MCP2515_Read_Status();
+    if (status & (MCP2515_STATUS_RX0IF | MCP2515_STATUS_RX1IF)) {
+      MCP2515_Read_RX_Buffer(MCP2515_Next_RX_Buffer(status), &frame);
+      (*frames)++;
+      if (MCP2515_Is_OBD_Response(&frame, 1)) (*votes)++;
+      if (MCP2515_Is_OBD_Response(&frame, 0)) (*votes)--;
+    }
+    if (MCP2515_Read_Register(MCP2515_REG_CANINTF) & MCP2515_INT_MERRF) {
+      (*errors)++;
+      MCP2515_Bit_Modify(MCP2515_REG_CANINTF, MCP2515_INT_MERRF, 0x00);
+    }
+    // Досрочное решение: скорость явно подходит или явно нет
+    if (*frames >= MCP2515_DETECT_FRAMES && *errors == 0) break;
+    if (*errors >= MCP2515_DETECT_ERRORS && *frames == 0) break;
+  }
+}
 
-  // 5. Настройка буфера RXB0 на использование фильтра 0
-  MCP2515_Write_Register(MCP2515_REG_RXB0CTRL, 0x20); // Использовать фильтры, принимать только сообщения, прошедшие фильтр
+/**
+  * @brief  Пробный запрос 01 00 (поддерживаемые PID) в нормальном режиме.
+  * @retval 1 - получен ответ ECU с той же адресацией
+  */
+static uint8_t MCP2515_Detect_Probe(const MCP2515_Bit_Timing *timing, uint8_t extended)
+{
+  static const uint8_t request[8] = {0x02, 0x01, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00};
+  uint32_t start = HAL_GetTick();
+  uint8_t answered = 0;
+  CAN_Frame frame;
 
-  // 6. Возврат в нормальный режим
-  MCP2515_Write_Register(MCP2515_REG_CANCTRL, 0x00);
-  HAL_Delay(10);
+  if (!MCP2515_Detect_Setup(timing, MCP2515_MODE_NORMAL)) return 0;
+  MCP2515_Load_TX_Buffer(0, extended ? CAN_ISO27145_REQUEST_ID : CAN_OBD_REQUEST_ID, extended, 8, request, 1);
+
+  while (!answered && (HAL_GetTick() - start) < MCP2515_DETECT_PROBE_MS) {
+    uint8_t status = MCP2515_Read_Status();
+    if (status & (MCP2515_STATUS_RX0IF | MCP2515_STATUS_RX1IF)) {
+      MCP2515_Read_RX_Buffer(MCP2515_Next_RX_Buffer(status), &frame);
+      answered = MCP2515_Is_OBD_Response(&frame, extended) && frame.data[1] == 0x41;
+    }
+  }
+  // Запрос без ACK повторяется бесконечно - отменяем
+  MCP2515_TX_Abort_All();
+  return answered;
+}
+
+uint8_t MCP2515_Auto_Detect(MCP2515_Detect_Result *result)
+{
+  static const uint32_t bitrates[] = {500000, 250000, 1000000, 125000};
+  MCP2515_Bit_Timing timing;
+  int16_t votes = 0;
+  uint16_t best_score = 0;
+
+  memset(result, 0, sizeof(*result));
+  MCP2515_Disable_IRQ();
+
+  // 1. Прослушивание: на неверной скорости кадры не проходят CRC и ставят MERRF
+  for (uint8_t i = 0; i < sizeof(bitrates) / sizeof(bitrates[0]); i++) {
+    uint16_t frames, errors;
+    if (!MCP2515_Get_Bit_Timing(MCP2515_OSC_HZ, bitrates[i], &timing)) continue;
+    MCP2515_Detect_Listen(&timing, &frames, &errors, &votes);
+    if (frames > errors && frames - errors > best_score) {
+      best_score = frames - errors;
+      result->bitrate = bitrates[i];
+      result->frames = frames;
+      result->errors = errors;
+    }
+    if (frames >= MCP2515_DETECT_FRAMES && errors == 0) break;
+  }
+
+  // 2. Пробные запросы: сначала адресация, за которую голосовал трафик.
+  //    Без трафика передавать можно только на скоростях ISO 15765-4.
+  for (uint8_t i = 0; i < 2 && !result->answered; i++) {
+    uint32_t bitrate = result->bitrate ? result->bitrate : bitrates[i];
+    if (result->bitrate && i > 0) break;
+    if (!MCP2515_Get_Bit_Timing(MCP2515_OSC_HZ, bitrate, &timing)) continue;
+    for (uint8_t n = 0; n < 2; n++) {
+      uint8_t extended = (votes > 0) ^ n;
+      if (MCP2515_Detect_Probe(&timing, extended)) {
+        result->bitrate = bitrate;
+        result->extended = extended;
+        result->answered = 1;
+        break;
+      }
+    }
+  }
+  if (!result->answered) result->extended = votes > 0;
+
+  MCP2515_Set_Mode(MCP2515_MODE_CONFIG);
+  return result->bitrate != 0;
+}
+
+uint8_t MCP2515_Init_Auto(MCP2515_Detect_Result *result)
+{
+  MCP2515_Detect_Result detect;
+  uint8_t found = MCP2515_Auto_Detect(&detect);
+
+  MCP2515_Set_Bitrate(found ? detect.bitrate : MCP2515_BITRATE_DEFAULT);
+  if (found && detect.extended) {
+    MCP2515_Init_ISO27145();
+  } else {
+    MCP2515_Init_ISO15765();
+  }
+  if (result) *result = detect;
+  return found;
 }
 
 /**
@@ -222,25 +1042,20 @@ void MCP2515_Init_With_Filter(void) {
   */
 uint8_t MCP2515_Read_Message_Polling(uint8_t *data, uint8_t pid, uint32_t timeout) {
   uint32_t wait_start = HAL_GetTick();
+  CAN_Frame frame;
 
   while((HAL_GetTick() - wait_start) < timeout){
-    // ОПРОС флага принятия сообщения в регистре CANINTF (бит 0 - RX0IF)
-      if (MCP2515_Read_Register(MCP2515_REG_CANINTF) & 0x01) {
-        
-        // Читаем DLC чтобы узнать длину данных
-        uint8_t dlc = MCP2515_Read_Register(MCP2515_REG_RXB0DLC) & 0x0F;
-        
-        // Читаем данные из буфера RXB0
-        for (int i = 0; i < dlc; i++) {
-          data[i] = MCP2515_Read_Register(MCP2515_REG_RXB0D0 + i);
-        }
-        
-        // !!! ВАЖНО: Сбрасываем флаг вручную, записывая 0 в бит RX0IF !!!
-        MCP2515_Write_Register(MCP2515_REG_CANINTF, 0x00);
-        if(data[2] == pid)
-            { return dlc;} // Возвращаем количество принятых байт
+      // Кадры вычитывает прерывание INT, здесь только разбираем кольцевой буфер
+      if (MCP2515_RX_Pop(&frame)) {
+        memcpy(data, frame.data, frame.dlc);
+        if(frame.dlc > 2 && data[2] == pid)
+            { return frame.dlc;} // Возвращаем количество принятых байт
+        continue; // Сразу проверяем, нет ли следующего кадра
       }
-      HAL_Delay(1);
+      if (MCP2515_TX_Pending()) {
+        MCP2515_TX_Service(); // Таймауты передачи, если TXnIF так и не пришел
+      }
+      __WFI(); // Спим до следующего прерывания (INT или SysTick)
   }
   return 0; // Сообщения нет
 }
@@ -262,23 +1077,14 @@ void MCP2515_Send_OBD_Request(uint16_t can_id, uint8_t pid) {
   tx_buffer[6] = 0x00;
   tx_buffer[7] = 0x00;
 
-  // 1. Записываем ID сообщения (11-bit)
-  MCP2515_Write_Register(MCP2515_REG_TXB0SIDH, (uint8_t)(can_id >> 3)); // Старшие 8 бит ID
-  MCP2515_Write_Register(MCP2515_REG_TXB0SIDL, (uint8_t)(can_id << 5)); // Младшие 3 бита ID
-
-  // 2. Записываем DLC (длину данных) = 8
-  MCP2515_Write_Register(MCP2515_REG_TXB0DLC, 0x08);
-
-  // 3. Записываем данные
-  for (int i = 0; i < 8; i++) {
-    MCP2515_Write_Register(MCP2515_REG_TXB0D0 + i, tx_buffer[i]);
+  // После MCP2515_Init_ISO27145 широковещательный запрос идет 29-битным ID
+  if (obd_extended && can_id == CAN_OBD_REQUEST_ID) {
+    MCP2515_Send_Frame(CAN_ISO27145_REQUEST_ID, 1, 8, tx_buffer);
+    return;
   }
 
-  // 4. Запрашиваем отправку (RTS) для буфера TXB0
-  uint8_t rts_cmd = MCP2515_CMD_RTS_TX0;
-  HAL_GPIO_WritePin(CS__GPIO_Port, CS__Pin, GPIO_PIN_RESET);
-  HAL_SPI_Transmit(&hspi1, &rts_cmd, 1, HAL_MAX_DELAY);
-  HAL_GPIO_WritePin(CS__GPIO_Port, CS__Pin, GPIO_PIN_SET);
+  // Через очередь передачи: не ждем освобождения буфера, запросы идут конвейером
+  MCP2515_Send_Frame(can_id, 0, 8, tx_buffer);
 }
 
 /**
@@ -332,38 +1138,9 @@ DTC_Status Parse_DTC_Status(uint8_t *data, uint8_t length) {
   * @brief  Обработка отрицательного ответа
   */
 int Handle_Negative_Response(uint8_t *data, uint8_t length) {
-
-    if (data[1] != 0x71)
-        { return 0;}
-
-    if (length >= 4) {
-        uint8_t requested_service = data[2];
-        uint8_t error_code = data[3];
-        
-        printf("NRC: Service 0x%02X, Error: 0x%02X - ", requested_service, error_code);
-        
-        switch (error_code) {
-            case 0x11:
-                printf("Service not supported\n");
-                break;
-            case 0x12:
-                printf("Sub-function not supported\n");
-                break;
-            case 0x13:
-                printf("Invalid format\n");
-                break;
-            case 0x22:
-                printf("Conditions not correct\n");
-                break;
-            case 0x31:
-                printf("Request out of range\n");
-                break;
-            default:
-                printf("Unknown error\n");
-                break;
-        }
-    }
-    return 1;
+  // Одиночный кадр [PCI 7F SID NRC]; вывод - по месту (UDS_NRC_Name), не в горячем пути
+  if (length < 4 || data[1] != UDS_SID_NEGATIVE) return 0;
+  return data[3];
 }
 
 
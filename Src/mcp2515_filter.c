@@ -0,0 +1,309 @@
+#include "mcp2515_filter.h"
+#include "mcp2515.h"
+#include <string.h>
+
+// Все 29 бит идентификатора и только биты SID (стандартный ID << 18)
+#define ID_BITS_ALL  0x1FFFFFFFu
+#define ID_BITS_SID  0x1FFC0000u
+
+#define GROUP0_FILTERS  2  // RXF0-RXF1 -> RXM0 (RXB0)
+#define GROUP1_FILTERS  4  // RXF2-RXF5 -> RXM1 (RXB1)
+#define MAX_CLUSTERS    (GROUP0_FILTERS + GROUP1_FILTERS)
+
+// Блок идентификаторов: все ID, у которых биты care совпадают с value
+typedef struct {
+  uint32_t value;
+  uint32_t care;
+  uint8_t  ext;
+} ID_Pattern;
+
+// Лучшее найденное решение
+typedef struct {
+  ID_Pattern cluster[MAX_CLUSTERS];
+  uint8_t    count;
+  uint8_t    group0;  // Битовая маска кластеров, отданных RXB0
+} Filter_Solution;
+
+static uint32_t Type_Bits(uint8_t ext)
+{
+  return ext ? ID_BITS_ALL : ID_BITS_SID;
+}
+
+/**
+  * @brief  Доля своего пространства ID, пропускаемая фильтром с маской mask,
+  *         в единицах 2^-29 (одинаковый масштаб для 11- и 29-битных ID).
+  */
+static uint64_t Block_Cost(uint32_t mask, uint8_t ext)
+{
+  return 1ull << (29 - __builtin_popcount(mask & Type_Bits(ext)));
+}
+
+/**
+  * @brief  Разбиение диапазона на выровненные блоки степени двойки.
+  * @retval Новое количество шаблонов или 0xFF при переполнении
+  */
+static uint8_t Split_Range(const CAN_Filter_Range *range, ID_Pattern *out, uint8_t n)
+{
+  uint8_t bits = range->extended ? 29 : 11;
+  uint32_t full = (1u << bits) - 1;
+  uint32_t a = range->id_from & full;
+  uint32_t to = range->id_to > full ? full : range->id_to;
+
+  while (a <= to) {
+    uint8_t k = 0;
+    // Расширяем блок, пока он выровнен и не выходит за конец диапазона
+    while (k < bits && (a & ((2u << k) - 1)) == 0 && a + (2u << k) - 1 <= to) k++;
+
+    if (n >= MCP2515_FILTER_MAX_PATTERNS) return 0xFF;
+    out[n].value = a;
+    out[n].care = full & ~((1u << k) - 1);
+    out[n].ext = range->extended;
+    if (!range->extended) {
+      out[n].value <<= 18;
+      out[n].care <<= 18;
+    }
+    n++;
+
+    if (a + (1u << k) - 1 >= to) break; // Без переполнения при to == full
+    a += 1u << k;
+  }
+  return n;
+}
+
+/**
+  * @brief  Объединение двух блоков в наименьший покрывающий оба.
+  */
+static void Merge(ID_Pattern *a, const ID_Pattern *b)
+{
+  a->care &= b->care & ~(a->value ^ b->value);
+  a->value &= a->care;
+}
+
+/**
+  * @brief  Фильтры одной группы с общей маской: маска - пересечение care
+  *         всех кластеров группы, одинаковые значения фильтров склеиваются.
+  * @param  filters: Различные фильтры группы (NULL - только подсчет)
+  * @retval Количество различных фильтров
+  */
+static uint8_t Group_Filters(const ID_Pattern *c, uint8_t n, uint8_t sel,
+                             uint32_t *mask, ID_Pattern *filters, uint64_t *cost)
+{
+  ID_Pattern f[MAX_CLUSTERS];
+  uint8_t count = 0;
+
+  *mask = ID_BITS_ALL;
+  for (uint8_t i = 0; i < n; i++) {
+    if (sel & (1u << i)) *mask &= c[i].care;
+  }
+
+  *cost = 0;
+  for (uint8_t i = 0; i < n; i++) {
+    if (!(sel & (1u << i))) continue;
+    uint32_t value = c[i].value & *mask;
+    uint8_t dup = 0;
+    for (uint8_t j = 0; j < count; j++) {
+      if (f[j].value == value && f[j].ext == c[i].ext) dup = 1;
+    }
+    if (dup) continue;
+    f[count].value = value;
+    f[count].care = *mask;
+    f[count].ext = c[i].ext;
+    *cost += Block_Cost(*mask, c[i].ext);
+    count++;
+  }
+  if (filters) memcpy(filters, f, count * sizeof(ID_Pattern));
+  return count;
+}
+
+/**
+  * @brief  Лучшая раскладка n <= 6 кластеров по группам RXB0/RXB1.
+  * @retval Стоимость (UINT64_MAX - не помещается)
+  */
+static uint64_t Best_Partition(const ID_Pattern *c, uint8_t n, uint8_t *group0)
+{
+  uint64_t best = UINT64_MAX;
+  uint8_t all = (1u << n) - 1;
+
+  for (uint8_t sel = 0; sel <= all; sel++) {
+    uint32_t mask;
+    uint64_t cost0, cost1;
+    if (Group_Filters(c, n, sel, &mask, NULL, &cost0) > GROUP0_FILTERS) continue;
+    if (Group_Filters(c, n, all & ~sel, &mask, NULL, &cost1) > GROUP1_FILTERS) continue;
+    if (cost0 + cost1 < best) {
+      best = cost0 + cost1;
+      *group0 = sel;
+    }
+  }
+  return best;
+}
+
+/**
+  * @brief  Проверка 11-битного ID на прохождение фильтров группы.
+  */
+static uint8_t Std_Accepted(const MCP2515_Filter_Config *cfg, uint32_t key)
+{
+  for (uint8_t i = 0; i < 6; i++) {
+    uint32_t mask = cfg->mask[i < GROUP0_FILTERS ? 0 : 1] & ID_BITS_SID;
+    if (!cfg->filter_ext[i] && (key & mask) == (cfg->filter[i] & mask)) return 1;
+  }
+  return 0;
+}
+
+/**
+  * @brief  Раскладка решения в регистры: неиспользуемые фильтры повторяют
+  *         первый фильтр группы, пустая группа получает маску "все биты"
+  *         и фильтр из другой группы, чтобы не пропускать ничего лишнего.
+  */
+static void Fill_Config(const Filter_Solution *sol, MCP2515_Filter_Config *cfg)
+{
+  ID_Pattern f[2][MAX_CLUSTERS];
+  uint8_t cnt[2];
+  uint8_t all = (1u << sol->count) - 1;
+  uint64_t cost;
+  static const uint8_t first[2] = {0, GROUP0_FILTERS};
+  static const uint8_t size[2] = {GROUP0_FILTERS, GROUP1_FILTERS};
+
+  cnt[0] = Group_Filters(sol->cluster, sol->count, sol->group0, &cfg->mask[0], f[0], &cost);
+  cnt[1] = Group_Filters(sol->cluster, sol->count, all & ~sol->group0, &cfg->mask[1], f[1], &cost);
+
+  for (uint8_t g = 0; g < 2; g++) {
+    uint8_t other = g ^ 1;
+    if (cnt[g] == 0) {
+      cfg->mask[g] = ID_BITS_ALL;
+      if (cnt[other]) {
+        f[g][0] = f[other][0];
+      } else {
+        f[g][0].value = 0; // Нужных ID нет: принимается только стандартный ID 0x000
+        f[g][0].ext = 0;
+      }
+      cnt[g] = 1;
+    }
+    for (uint8_t i = 0; i < size[g]; i++) {
+      const ID_Pattern *p = &f[g][i < cnt[g] ? i : 0];
+      cfg->filter[first[g] + i] = p->value;
+      cfg->filter_ext[first[g] + i] = p->ext;
+    }
+  }
+}
+
+uint8_t MCP2515_Filter_Solve(const CAN_Filter_Range *ranges, uint8_t count, MCP2515_Filter_Config *cfg)
+{
+  ID_Pattern c[MCP2515_FILTER_MAX_PATTERNS];
+  Filter_Solution best = {0};
+  uint64_t best_cost = UINT64_MAX;
+  uint8_t n = 0;
+
+  memset(cfg, 0, sizeof(*cfg));
+
+  for (uint8_t i = 0; i < count; i++) {
+    n = Split_Range(&ranges[i], c, n);
+    if (n == 0xFF) return 0;
+    if (ranges[i].extended && ranges[i].id_to >= ranges[i].id_from) {
+      cfg->wanted_ext += ranges[i].id_to - ranges[i].id_from + 1;
+    }
+  }
+
+  for (;;) {
+    if (n <= MAX_CLUSTERS) {
+      uint8_t group0 = 0;
+      uint64_t cost = Best_Partition(c, n, &group0);
+      if (cost < best_cost) {
+        best_cost = cost;
+        memcpy(best.cluster, c, n * sizeof(ID_Pattern));
+        best.count = n;
+        best.group0 = group0;
+      }
+    }
+    if (n <= 1) break;
+
+    // Жадно объединяем пару одного типа с наименьшим приростом стоимости
+    int64_t best_delta = INT64_MAX;
+    uint8_t bi = 0, bj = 0;
+    for (uint8_t i = 0; i < n; i++) {
+      for (uint8_t j = i + 1; j < n; j++) {
+        if (c[i].ext != c[j].ext) continue;
+        ID_Pattern m = c[i];
+        Merge(&m, &c[j]);
+        int64_t delta = (int64_t)Block_Cost(m.care, m.ext) -
+                        (int64_t)Block_Cost(c[i].care, c[i].ext) -
+                        (int64_t)Block_Cost(c[j].care, c[j].ext);
+        if (delta < best_delta) {
+          best_delta = delta;
+          bi = i;
+          bj = j;
+        }
+      }
+    }
+    if (best_delta == INT64_MAX) break; // Остались по одному кластеру каждого типа
+
+    Merge(&c[bi], &c[bj]);
+    c[bj] = c[--n];
+  }
+
+  Fill_Config(&best, cfg);
+
+  // Оценка: 11-битное пространство перебираем точно, 29-битное - суммой блоков
+  for (uint32_t id = 0; id < 0x800; id++) {
+    uint32_t key = id << 18;
+    for (uint8_t i = 0; i < count; i++) {
+      if (!ranges[i].extended && id >= ranges[i].id_from && id <= ranges[i].id_to) {
+        cfg->wanted_std++;
+        break;
+      }
+    }
+    cfg->accepted_std += Std_Accepted(cfg, key);
+  }
+  for (uint8_t i = 0; i < 6; i++) {
+    uint32_t mask_i = cfg->mask[i < GROUP0_FILTERS ? 0 : 1];
+    uint8_t covered = 0;
+    if (!cfg->filter_ext[i]) continue;
+    // Фильтр, целиком покрытый другим (повтор или пустая группа), не считаем
+    for (uint8_t j = 0; j < 6; j++) {
+      uint32_t mask_j = cfg->mask[j < GROUP0_FILTERS ? 0 : 1];
+      if (j == i || !cfg->filter_ext[j]) continue;
+      if ((mask_j & ~mask_i) || ((cfg->filter[i] ^ cfg->filter[j]) & mask_j)) continue;
+      if (mask_j != mask_i || j < i) covered = 1;
+    }
+    if (!covered) cfg->accepted_ext += (uint32_t)Block_Cost(mask_i, 1);
+  }
+  if (cfg->accepted_ext < cfg->wanted_ext) cfg->accepted_ext = cfg->wanted_ext;
+
+  if (cfg->wanted_std < 0x800) {
+    cfg->false_accept_ppm_std = (uint32_t)((uint64_t)(cfg->accepted_std - cfg->wanted_std) * 1000000 /
+                                           (0x800 - cfg->wanted_std));
+  }
+  if (cfg->wanted_ext < (1u << 29)) {
+    cfg->false_accept_ppm_ext = (uint32_t)((uint64_t)(cfg->accepted_ext - cfg->wanted_ext) * 1000000 /
+                                           ((1u << 29) - cfg->wanted_ext));
+  }
+  return 1;
+}
+
+/**
+  * @brief  Упаковка 29-битного ключа в SIDH, SIDL, EID8, EID0.
+  */
+static void Encode_Key(uint32_t key, uint8_t ext, uint8_t *regs)
+{
+  regs[0] = (uint8_t)(key >> 21);
+  regs[1] = (uint8_t)(((key >> 13) & 0xE0) | (ext ? 0x08 : 0x00) | ((key >> 16) & 0x03));
+  regs[2] = (uint8_t)(key >> 8);
+  regs[3] = (uint8_t)key;
+}
+
+void MCP2515_Filter_Apply(const MCP2515_Filter_Config *cfg)
+{
+  uint8_t regs[12];
+
+  // RXF0-RXF2: 0x00-0x0B
+  for (uint8_t i = 0; i < 3; i++) Encode_Key(cfg->filter[i], cfg->filter_ext[i], &regs[4 * i]);
+  MCP2515_Write_Registers(MCP2515_REG_RXF0SIDH, regs, 12);
+
+  // RXF3-RXF5: 0x10-0x1B
+  for (uint8_t i = 0; i < 3; i++) Encode_Key(cfg->filter[3 + i], cfg->filter_ext[3 + i], &regs[4 * i]);
+  MCP2515_Write_Registers(MCP2515_REG_RXF3SIDH, regs, 12);
+
+  // RXM0-RXM1: 0x20-0x27 (в маске бит EXIDE не используется)
+  Encode_Key(cfg->mask[0], 0, &regs[0]);
+  Encode_Key(cfg->mask[1], 0, &regs[4]);
+  MCP2515_Write_Registers(MCP2515_REG_RXM0SIDH, regs, 8);
+}
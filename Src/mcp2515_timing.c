@@ -0,0 +1,80 @@
+#include "mcp2515_timing.h"
+
+// Строка таблицы: сегменты заданы в Tq, регистры CNF считаются препроцессором
+#define TIMING(osc, rate, brp, prop, ps1, ps2, sjw)                         \
+  { (osc), (rate), (brp), (prop), (ps1), (ps2), (sjw),                      \
+    (uint16_t)((1u + (prop) + (ps1)) * 1000u / (1u + (prop) + (ps1) + (ps2))), \
+    MCP2515_CNF1(brp, sjw), MCP2515_CNF2(prop, ps1), MCP2515_CNF3(ps2) }
+
+// Результаты MCP2515_Calc_Bit_Timing для типовых кварцев и скоростей.
+// 8 МГц и 1 Мбит/с несовместимы: на бит нужно минимум 5 Tq.
+static const MCP2515_Bit_Timing timing_table[] = {
+  TIMING( 8000000u,  125000u, 1, 6, 7, 2, 1),
+  TIMING( 8000000u,  250000u, 0, 6, 7, 2, 1),
+  TIMING( 8000000u,  500000u, 0, 2, 3, 2, 1),
+  TIMING(16000000u,  125000u, 3, 6, 7, 2, 1),
+  TIMING(16000000u,  250000u, 1, 6, 7, 2, 1),
+  TIMING(16000000u,  500000u, 0, 6, 7, 2, 1),
+  TIMING(16000000u, 1000000u, 0, 2, 3, 2, 1),
+  TIMING(20000000u,  125000u, 4, 6, 7, 2, 1),
+  TIMING(20000000u,  250000u, 1, 8, 8, 3, 2),
+  TIMING(20000000u,  500000u, 0, 8, 8, 3, 2),
+  TIMING(20000000u, 1000000u, 0, 3, 3, 3, 2),
+};
+
+uint8_t MCP2515_Calc_Bit_Timing(uint32_t osc_hz, uint32_t bitrate, MCP2515_Bit_Timing *timing)
+{
+  uint16_t target = MCP2515_SAMPLE_POINT(bitrate);
+  uint16_t best_err = 0xFFFF;
+
+  if (bitrate == 0) return 0;
+
+  // BRP по возрастанию: при равной ошибке остается вариант с большим числом Tq
+  for (uint8_t brp = 0; brp < 64; brp++) {
+    uint32_t div = 2u * (brp + 1u) * bitrate;
+    if (osc_hz % div) continue;
+
+    uint32_t ntq = osc_hz / div;
+    if (ntq < 5 || ntq > 25) continue;
+
+    // PS2 по целевой точке выборки с округлением, PS2 >= 2 (время обработки)
+    uint32_t ps2 = (ntq * (1000u - target) + 500u) / 1000u;
+    if (ps2 < 2) ps2 = 2;
+    if (ps2 > 8) ps2 = 8;
+    uint32_t tseg1 = ntq - 1u - ps2;
+    while (tseg1 < ps2 && ps2 > 2) { ps2--; tseg1++; } // PropSeg + PS1 >= PS2
+    if (tseg1 > 16) { ps2 += tseg1 - 16u; tseg1 = 16; }
+    if (tseg1 < 2 || tseg1 < ps2 || ps2 > 8) continue;
+
+    uint16_t sp = (uint16_t)((1u + tseg1) * 1000u / ntq);
+    uint16_t err = sp > target ? sp - target : target - sp;
+    if (err >= best_err) continue;
+    best_err = err;
+
+    timing->osc_hz = osc_hz;
+    timing->bitrate = bitrate;
+    timing->brp = brp;
+    timing->ps1 = (uint8_t)((tseg1 + 1u) / 2u);
+    timing->prop = (uint8_t)(tseg1 - timing->ps1);
+    timing->ps2 = (uint8_t)ps2;
+    // SJW <= PS1 и строго меньше PS2 (требование MCP2515), не больше 4 Tq
+    timing->sjw = timing->ps1 < timing->ps2 - 1u ? timing->ps1 : timing->ps2 - 1u;
+    if (timing->sjw > 4) timing->sjw = 4;
+    timing->sample_point = sp;
+    timing->cnf1 = MCP2515_CNF1(timing->brp, timing->sjw);
+    timing->cnf2 = MCP2515_CNF2(timing->prop, timing->ps1);
+    timing->cnf3 = MCP2515_CNF3(timing->ps2);
+  }
+  return best_err != 0xFFFF;
+}
+
+uint8_t MCP2515_Get_Bit_Timing(uint32_t osc_hz, uint32_t bitrate, MCP2515_Bit_Timing *timing)
+{
+  for (uint8_t i = 0; i < sizeof(timing_table) / sizeof(timing_table[0]); i++) {
+    if (timing_table[i].osc_hz == osc_hz && timing_table[i].bitrate == bitrate) {
+      *timing = timing_table[i];
+      return 1;
+    }
+  }
+  return MCP2515_Calc_Bit_Timing(osc_hz, bitrate, timing);
+}
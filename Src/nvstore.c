@@ -0,0 +1,164 @@
+#include "main.h"
+#include "nvstore.h"
+#include <string.h>
+
+#define NV_EMPTY  0xFFFFFFFFu
+
+#define NV_WORD(addr)  (*(const volatile uint32_t *)(addr))
+
+uint32_t NV_CRC32(uint32_t crc, const void *data, uint32_t len)
+{
+  const uint8_t *p = data;
+
+  crc = ~crc;
+  while (len--) {
+    crc ^= *p++;
+    for (uint8_t i = 0; i < 8; i++) crc = (crc >> 1) ^ (0xEDB88320u & -(crc & 1));
+  }
+  return ~crc;
+}
+
+/**
+  * @brief  Размер записи во flash вместе с заголовком и CRC
+  */
+static uint32_t NV_Record_Size(uint8_t len)
+{
+  return 8 + ((len + 3u) & ~3u) + 4;
+}
+
+/**
+  * @brief  Запись журнала по адресу addr.
+  * @param  valid: 1 - запись цела (CRC сошлась)
+  * @retval Размер записи, 0 - дальше записей нет (свободно или журнал испорчен)
+  */
+static uint32_t NV_Record(uint32_t addr, uint8_t *valid)
+{
+  *valid = 0;
+  if (addr + 12 > NV_BASE + NV_SIZE) return 0;
+
+  uint32_t head = NV_WORD(addr);
+  if ((head & 0xFFFF) != NV_MAGIC) return 0;
+  uint32_t size = NV_Record_Size(head >> 24);
+  if (addr + size > NV_BASE + NV_SIZE) return 0;
+
+  // Запись, прерванная сбросом, не проходит CRC и пропускается
+  *valid = NV_CRC32(0, (const void *)addr, size - 4) == NV_WORD(addr + size - 4);
+  return size;
+}
+
+/**
+  * @brief  Проход по журналу.
+  * @param  found: Последняя целая запись type/key (0 - нет)
+  * @retval Адрес первого свободного слова, NV_BASE + NV_SIZE - места нет
+  *         или журнал испорчен
+  */
+static uint32_t NV_Scan(uint8_t type, uint32_t key, uint32_t *found)
+{
+  uint32_t addr = NV_BASE, size;
+  uint8_t valid;
+
+  *found = 0;
+  while ((size = NV_Record(addr, &valid)) != 0) {
+    if (valid && ((NV_WORD(addr) >> 16) & 0xFF) == type && NV_WORD(addr + 4) == key) *found = addr;
+    addr += size;
+  }
+  if (addr + 12 <= NV_BASE + NV_SIZE && NV_WORD(addr) == NV_EMPTY) return addr;
+  return NV_BASE + NV_SIZE;
+}
+
+uint8_t NV_Read(uint8_t type, uint32_t key, void *data, uint8_t len)
+{
+  uint32_t found;
+
+  NV_Scan(type, key, &found);
+  if (!found || (NV_WORD(found) >> 24) != len) return 0;
+  memcpy(data, (const void *)(found + 8), len);
+  return 1;
+}
+
+static void NV_Unlock(void)
+{
+  HAL_FLASH_Unlock();
+  __HAL_FLASH_CLEAR_FLAG(FLASH_FLAG_EOP | FLASH_FLAG_OPERR | FLASH_FLAG_WRPERR |
+                         FLASH_FLAG_PGAERR | FLASH_FLAG_PGPERR | FLASH_FLAG_PGSERR);
+}
+
+static uint8_t NV_Erase(void)
+{
+  FLASH_EraseInitTypeDef erase = {0};
+  uint32_t error;
+
+  erase.TypeErase = FLASH_TYPEERASE_SECTORS;
+  erase.Sector = NV_SECTOR;
+  erase.NbSectors = 1;
+  erase.VoltageRange = FLASH_VOLTAGE_RANGE_3;
+  return HAL_FLASHEx_Erase(&erase, &error) == HAL_OK;
+}
+
+uint8_t NV_Write(uint8_t type, uint32_t key, const void *data, uint8_t len)
+{
+  uint32_t words[2 + (NV_DATA_MAX + 3) / 4 + 1];
+  uint32_t size = NV_Record_Size(len);
+  uint32_t found;
+  uint8_t ok = 1;
+
+  uint32_t addr = NV_Scan(type, key, &found);
+  if (found && (NV_WORD(found) >> 24) == len && memcmp((const void *)(found + 8), data, len) == 0) {
+    return 1;
+  }
+
+  memset(words, 0xFF, sizeof(words));
+  words[0] = NV_MAGIC | ((uint32_t)type << 16) | ((uint32_t)len << 24);
+  words[1] = key;
+  memcpy(&words[2], data, len);
+  words[size / 4 - 1] = NV_CRC32(0, words, size - 4);
+
+  // Стирать сектор на ходу нельзя: стоят прерывания MCP2515 и ISO-TP - ждем старта
+  if (addr + size > NV_BASE + NV_SIZE) return 0;
+
+  NV_Unlock();
+  for (uint32_t i = 0; ok && i < size / 4; i++) {
+    ok = HAL_FLASH_Program(FLASH_TYPEPROGRAM_WORD, addr + i * 4, words[i]) == HAL_OK;
+  }
+  HAL_FLASH_Lock();
+  return ok;
+}
+
+uint8_t NV_Compact(void)
+{
+  uint32_t keep[NV_COMPACT_MAX / 4]; // Живые записи подряд, как во flash
+  uint32_t used = 0, addr, size, found;
+  uint8_t valid, ok;
+
+  if (NV_BASE + NV_SIZE - NV_Scan(0, 0, &found) >= NV_RESERVE) return 1;
+
+  for (addr = NV_BASE; (size = NV_Record(addr, &valid)) != 0; addr += size) {
+    if (!valid) continue;
+    uint32_t head = NV_WORD(addr), key = NV_WORD(addr + 4);
+
+    // Прежняя запись того же type/key устарела
+    for (uint32_t i = 0; i < used; i += NV_Record_Size(keep[i] >> 24) / 4) {
+      if (((keep[i] ^ head) & 0x00FF0000u) || keep[i + 1] != key) continue;
+      uint32_t n = NV_Record_Size(keep[i] >> 24) / 4;
+      memmove(&keep[i], &keep[i + n], (used - i - n) * 4);
+      used -= n;
+      break;
+    }
+    // Места нет - вытесняются самые старые
+    while (used + size / 4 > NV_COMPACT_MAX / 4) {
+      uint32_t n = NV_Record_Size(keep[0] >> 24) / 4;
+      memmove(keep, &keep[n], (used - n) * 4);
+      used -= n;
+    }
+    memcpy(&keep[used], (const void *)addr, size);
+    used += size / 4;
+  }
+
+  NV_Unlock();
+  ok = NV_Erase();
+  for (uint32_t i = 0; ok && i < used; i++) {
+    ok = HAL_FLASH_Program(FLASH_TYPEPROGRAM_WORD, NV_BASE + i * 4, keep[i]) == HAL_OK;
+  }
+  HAL_FLASH_Lock();
+  return ok;
+}
@@ -0,0 +1,327 @@
+#include "main.h"
+#include "obd.h"
+#include "nvstore.h"
+#include <string.h>
+
+#define OBD_REJECTED  0xFF  // Запрос отвергнут: NRC или нет ответа
+
+void OBD_Init(OBD_Client *obd, uint8_t extended)
+{
+  memset(obd, 0, sizeof(*obd));
+  if (extended) {
+    ISOTP_Init(&obd->link, CAN_ISO27145_REQUEST_ID, OBD_ENGINE_ID_EXT, 1);
+    obd->link.fc_id = OBD_ENGINE_FC_EXT;
+  } else {
+    ISOTP_Init(&obd->link, CAN_OBD_REQUEST_ID, OBD_ENGINE_ID_STD, 0);
+    obd->link.fc_id = OBD_ENGINE_FC_STD;
+  }
+  obd->multi_pid = 1;
+  obd->multi_did = 1;
+  obd->timeout_ms = OBD_TIMEOUT_MS;
+}
+
+void OBD_Init_Physical(OBD_Client *obd, uint8_t extended, uint8_t ecu)
+{
+  memset(obd, 0, sizeof(*obd));
+  if (extended) {
+    ISOTP_Init(&obd->link, 0x18DA00F1 | ((uint32_t)ecu << 8), CAN_ISO27145_RESPONSE_ID | ecu, 1);
+  } else {
+    ISOTP_Init(&obd->link, 0x7E0 + (ecu & 7), CAN_OBD_RESPONSE_ID + (ecu & 7), 0);
+  }
+  obd->multi_pid = 1;
+  obd->multi_did = 1;
+  obd->timeout_ms = OBD_TIMEOUT_MS;
+}
+
+/**
+  * @brief  Функциональный запрос PID 0x00 и сбор ответов за окно P2.
+  * @param  wwh: 1 - запрос ISO 27145 [22 F4 00], ответ [62 F4 00 A B C D]
+  */
+static uint8_t OBD_Enumerate_Request(uint8_t extended, uint8_t wwh, OBD_ECU_Info *ecus, uint8_t max)
+{
+  CAN_Frame frame;
+  uint8_t req[8] = {0x02, 0x01, 0x00, ISOTP_PADDING, ISOTP_PADDING, ISOTP_PADDING, ISOTP_PADDING, ISOTP_PADDING};
+  uint8_t head = wwh ? 4 : 3; // PCI, SID, PID (F4 xx) - дальше 4 байта карты
+  uint8_t count = 0;
+
+  if (wwh) {
+    req[0] = 0x03;
+    req[1] = UDS_SID_RDBI;
+    req[2] = OBD_WWH_DID_PID >> 8;
+    req[3] = 0x00;
+  }
+
+  while (MCP2515_RX_Pop(&frame)) {} // Старые кадры не относятся к запросу
+  if (!MCP2515_Send_Frame(extended ? CAN_ISO27145_REQUEST_ID : CAN_OBD_REQUEST_ID, extended, 8, req)) return 0;
+
+  // Окно P2 целиком: ECU отвечают в любом порядке, каждый своим ID
+  uint32_t start = HAL_GetTick();
+  while ((HAL_GetTick() - start) < OBD_TIMEOUT_MS) {
+    if (!MCP2515_RX_Pop(&frame)) {
+      if (MCP2515_TX_Pending()) MCP2515_TX_Service();
+      continue;
+    }
+    if (frame.extended != extended || frame.rtr || frame.dlc < head + 4) continue;
+    if (frame.data[0] != head + 3 || frame.data[1] != UDS_POSITIVE(req[1]) ||
+        memcmp(&frame.data[2], &req[2], head - 2) != 0) continue;
+    uint8_t ecu;
+    if (extended) {
+      if ((frame.id & 0xFFFFFF00) != CAN_ISO27145_RESPONSE_ID) continue;
+      ecu = (uint8_t)frame.id;
+    } else {
+      if (frame.id < CAN_OBD_RESPONSE_ID || frame.id > CAN_OBD_RESPONSE_ID + 7) continue;
+      ecu = frame.id - CAN_OBD_RESPONSE_ID;
+    }
+
+    // Повтор от того же ECU - не новый; вставка по возрастанию ID
+    uint8_t i = 0;
+    while (i < count && ecus[i].rx_id < frame.id) i++;
+    if ((i < count && ecus[i].rx_id == frame.id) || count >= max) continue;
+    memmove(&ecus[i + 1], &ecus[i], (count - i) * sizeof(ecus[0]));
+    ecus[i].rx_id = frame.id;
+    ecus[i].ecu = ecu;
+    ecus[i].wwh = wwh;
+    memcpy(ecus[i].supported, &frame.data[head], 4);
+    count++;
+  }
+  return count;
+}
+
+uint8_t OBD_Enumerate_ECUs(uint8_t extended, OBD_ECU_Info *ecus, uint8_t max)
+{
+  uint8_t count = OBD_Enumerate_Request(extended, 0, ecus, max);
+
+  // ECU только ISO 27145 (Euro VI и новее) на Mode 01 не отвечают
+  if (count == 0 && extended) count = OBD_Enumerate_Request(extended, 1, ecus, max);
+  return count;
+}
+
+static uint8_t OBD_Is_Unsupported(const OBD_Client *obd, uint8_t pid)
+{
+  return ((obd->unsupported[pid >> 3] >> (pid & 7)) & 1) || !OBD_PID_Supported(obd, pid);
+}
+
+uint8_t OBD_PID_Supported(const OBD_Client *obd, uint8_t pid)
+{
+  if (!obd->supported_valid || pid == 0x00) return 1;
+  uint8_t bit = pid - 1; // Бит 7 первого байта ответа на 0x00 - PID 0x01
+  return (obd->supported[bit >> 3] >> (7 - (bit & 7))) & 1;
+}
+
+uint8_t OBD_Set_Supported(OBD_Client *obd, uint8_t range_pid, const uint8_t *data)
+{
+  memcpy(&obd->supported[range_pid >> 3], data, 4);
+  if (range_pid == 0x00) {
+    memset(&obd->supported[4], 0, sizeof(obd->supported) - 4);
+    obd->supported_valid = 1;
+  }
+  // Младший бит последнего байта - поддержка PID следующего диапазона
+  return (range_pid < 0xE0 && (data[3] & 0x01)) ? range_pid + 0x20 : 0;
+}
+
+/**
+  * @brief  Ключ карты в кэше: VIN и адрес ответа, без VIN - отпечаток ECU
+  *         (адрес ответа и ответ на PID 0x00)
+  */
+static uint32_t OBD_Fingerprint(const OBD_Client *obd)
+{
+  if (obd->vehicle_key) return NV_CRC32(obd->vehicle_key, &obd->link.rx_id, sizeof(obd->link.rx_id));
+  uint32_t crc = NV_CRC32(0, &obd->link.rx_id, sizeof(obd->link.rx_id));
+  return NV_CRC32(crc, obd->supported, 4);
+}
+
+uint8_t OBD_Cache_Load(OBD_Client *obd)
+{
+  uint8_t map[sizeof(obd->supported)];
+
+  if (!NV_Read(NV_TYPE_PID_BITMAP, OBD_Fingerprint(obd), map, sizeof(map))) return 0;
+  // Ответ на PID 0x00 уже есть - должен совпасть (иначе совпадение CRC у разных ECU)
+  if (obd->supported_valid && memcmp(map, obd->supported, 4) != 0) return 0;
+  memcpy(obd->supported, map, sizeof(map));
+  obd->supported_valid = 1;
+  return 1;
+}
+
+void OBD_Cache_Store(OBD_Client *obd)
+{
+  NV_Write(NV_TYPE_PID_BITMAP, OBD_Fingerprint(obd), obd->supported, sizeof(obd->supported));
+}
+
+uint8_t OBD_Discover_PIDs(OBD_Client *obd)
+{
+  uint8_t req[3];
+  uint8_t resp[8];
+  OBD_PID_Value range = {0};
+
+  obd->supported_valid = 0;
+  do {
+    uint8_t req_len = OBD_Build_Request(obd, &range.pid, 1, req);
+    uint16_t len = ISOTP_Request(&obd->link, req, req_len, resp, sizeof(resp), obd->timeout_ms);
+    range.valid = 0;
+    if (OBD_Parse_Response(obd, resp, len, &range, 1) != 1 || range.len != 4) {
+      // Диапазон не ответил - следующие остаются пустыми
+      return obd->supported_valid;
+    }
+    uint8_t next = OBD_Set_Supported(obd, range.pid, range.data);
+    if (range.pid == 0x00 && OBD_Cache_Load(obd)) return 1;
+    range.pid = next;
+  } while (range.pid);
+
+  OBD_Cache_Store(obd);
+  return 1;
+}
+
+/**
+  * @brief  Один запрос Mode 01 и разбор составного ответа [41 PID A B.. PID A..].
+  * @retval Количество полученных PID или OBD_REJECTED
+  */
+static uint8_t OBD_Request(OBD_Client *obd, const uint8_t *pids, uint8_t count, OBD_PID_Value *values)
+{
+  uint8_t req[1 + 2 * OBD_MAX_PIDS_PER_REQUEST];
+  uint8_t resp[1 + OBD_MAX_PIDS_PER_REQUEST * (2 + OBD_PID_DATA_MAX)];
+
+  uint8_t req_len = OBD_Build_Request(obd, pids, count, req);
+  uint16_t len = ISOTP_Request(&obd->link, req, req_len, resp, sizeof(resp), obd->timeout_ms);
+
+  if (len >= 3 && resp[0] == UDS_SID_NEGATIVE && resp[1] == req[0]) {
+    obd->last_nrc = resp[2];
+    return OBD_REJECTED;
+  }
+  if (len < 2 || resp[0] != UDS_POSITIVE(req[0])) return OBD_REJECTED;
+  return OBD_Parse_Response(obd, resp, len, values, count);
+}
+
+uint8_t OBD_PID_Batch(const OBD_Client *obd)
+{
+  if (!obd->multi_pid) return 1;
+  return obd->wwh ? OBD_WWH_MAX_PIDS : OBD_MAX_PIDS_PER_REQUEST;
+}
+
+uint8_t OBD_Build_Request(const OBD_Client *obd, const uint8_t *pids, uint8_t count, uint8_t *req)
+{
+  uint8_t len = 0;
+
+  req[len++] = OBD_PID_SERVICE(obd);
+  for (uint8_t k = 0; k < count; k++) {
+    if (obd->wwh) req[len++] = OBD_WWH_DID_PID >> 8;
+    req[len++] = pids[k];
+  }
+  return len;
+}
+
+/**
+  * @brief  Разбор записей [PID A B..] (wwh: [F4 PID A B..]) после SID ответа
+  */
+static uint8_t OBD_Parse_Records(const uint8_t *resp, uint16_t len, uint8_t wwh,
+                                 OBD_PID_Value *values, uint8_t count)
+{
+  uint8_t head = wwh ? 2 : 1;
+  uint8_t got = 0;
+
+  for (uint16_t i = 1; i + head <= len; ) {
+    if (wwh && resp[i] != (OBD_WWH_DID_PID >> 8)) break; // Чужой DID - длина неизвестна
+    uint8_t pid = resp[i + head - 1];
+    uint8_t n = OBD_PID_Length(pid);
+    if (n == 0 && count == 1) {
+      // Единственный PID неизвестной длины - данные до конца ответа
+      n = len - i - head > OBD_PID_DATA_MAX ? OBD_PID_DATA_MAX : len - i - head;
+    }
+    if (n == 0 || i + head + n > len) break; // Без длины дальше разбирать нельзя
+    for (uint8_t j = 0; j < count; j++) {
+      if (values[j].pid == pid && !values[j].valid) {
+        memcpy(values[j].data, &resp[i + head], n);
+        values[j].len = n;
+        values[j].valid = 1;
+        got++;
+        break;
+      }
+    }
+    i += head + n;
+  }
+  return got;
+}
+
+uint8_t OBD_Parse_Response(const OBD_Client *obd, const uint8_t *resp, uint16_t len,
+                           OBD_PID_Value *values, uint8_t count)
+{
+  if (len < 2 || resp[0] != UDS_POSITIVE(OBD_PID_SERVICE(obd))) return 0;
+  return OBD_Parse_Records(resp, len, obd->wwh, values, count);
+}
+
+/**
+  * @brief  Учет ответа без PID: 1 - OBD_MISS_LIMIT раз подряд, пора отказаться.
+  *         Пришедший PID счетчик сбрасывает.
+  */
+static uint8_t OBD_PID_Miss(OBD_Client *obd, uint8_t pid, uint8_t missed)
+{
+  uint8_t shift = (pid & 3) * 2;
+  uint8_t n = (obd->misses[pid >> 2] >> shift) & 3;
+
+  n = missed ? (n < 3 ? n + 1 : 3) : 0;
+  obd->misses[pid >> 2] = (obd->misses[pid >> 2] & ~(3u << shift)) | (n << shift);
+  return n >= OBD_MISS_LIMIT;
+}
+
+uint8_t OBD_Read_PIDs(OBD_Client *obd, const uint8_t *pids, uint8_t count, OBD_PID_Value *values)
+{
+  uint8_t total = 0;
+
+  obd->last_nrc = 0;
+  for (uint8_t i = 0; i < count; i++) {
+    memset(&values[i], 0, sizeof(values[i]));
+    values[i].pid = pids[i];
+  }
+
+  for (uint8_t start = 0; start < count; ) {
+    uint8_t batch[OBD_MAX_PIDS_PER_REQUEST];
+    uint8_t index[OBD_MAX_PIDS_PER_REQUEST];
+    uint8_t n = 0;
+    uint8_t limit = OBD_PID_Batch(obd);
+
+    // Составной запрос: PID без известной длины можно разобрать только последним
+    while (start < count && n < limit) {
+      uint8_t pid = pids[start];
+      if (OBD_Is_Unsupported(obd, pid)) { start++; continue; }
+      if (n > 0 && OBD_PID_Length(pid) == 0) break;
+      batch[n] = pid;
+      index[n++] = start++;
+      if (OBD_PID_Length(pid) == 0) break;
+    }
+    if (n == 0) continue;
+
+    OBD_PID_Value part[OBD_MAX_PIDS_PER_REQUEST];
+    for (uint8_t k = 0; k < n; k++) {
+      memset(&part[k], 0, sizeof(part[k]));
+      part[k].pid = batch[k];
+    }
+
+    uint8_t got = OBD_Request(obd, batch, n, part);
+    if (n > 1 && (got == OBD_REJECTED || got < n)) {
+      // Недостающие PID по одному: если так они приходят раз за разом, ECU не умеет
+      // составные запросы (один потерянный кадр или медленный ответ - не повод)
+      uint8_t single_ok = 0;
+      for (uint8_t k = 0; k < n; k++) {
+        if (part[k].valid) continue;
+        if (OBD_Request(obd, &batch[k], 1, &part[k]) == 1) single_ok = 1;
+      }
+      if (single_ok && ++obd->batch_misses >= OBD_MISS_LIMIT) obd->multi_pid = 0;
+    } else if (n > 1) {
+      obd->batch_misses = 0;
+    }
+
+    for (uint8_t k = 0; k < n; k++) {
+      values[index[k]] = part[k];
+      total += part[k].valid;
+    }
+  }
+
+  // ECU на связи, но PID не пришел OBD_MISS_LIMIT раз подряд - не поддерживается,
+  // больше не спрашиваем
+  if (total > 0) {
+    for (uint8_t i = 0; i < count; i++) {
+      if (OBD_Is_Unsupported(obd, pids[i])) continue;
+      if (OBD_PID_Miss(obd, pids[i], !values[i].valid)) obd->unsupported[pids[i] >> 3] |= 1u << (pids[i] & 7);
+    }
+  }
+  return total;
+}
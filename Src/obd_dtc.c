@@ -0,0 +1,102 @@
+#include "main.h"
+#include "obd_dtc.h"
+#include <string.h>
+
+void OBD_DTC_Format(uint16_t code, char *out)
+{
+  static const char system[] = "PCBU";
+  static const char hex[] = "0123456789ABCDEF";
+
+  out[0] = system[code >> 14];
+  out[1] = '0' + ((code >> 12) & 0x03);
+  out[2] = hex[(code >> 8) & 0x0F];
+  out[3] = hex[(code >> 4) & 0x0F];
+  out[4] = hex[code & 0x0F];
+  out[5] = '\0';
+}
+
+static uint8_t OBD_DTC_Kind(uint8_t service)
+{
+  switch (service) {
+    case 0x03: return OBD_DTC_STORED;
+    case 0x07: return OBD_DTC_PENDING;
+    case 0x0A: return OBD_DTC_PERMANENT;
+    default:   return 0;
+  }
+}
+
+uint8_t OBD_DTC_Parse(OBD_DTC_Store *store, uint8_t service, const uint8_t *data, uint16_t len)
+{
+  uint8_t kind = OBD_DTC_Kind(service);
+  uint16_t pos = 0;
+  uint8_t n;
+
+  if (!kind) return 0;
+
+  // ISO 15765-4: первым байтом количество кодов; без него - старый формат, только пары
+  if (len >= 1 && len == 1 + 2 * data[0]) {
+    n = data[0];
+    pos = 1;
+  } else {
+    n = len / 2;
+  }
+
+  for (uint8_t i = 0; i < store->count; i++) store->dtc[i].kinds &= ~kind;
+  store->overflow = 0;
+
+  for (uint8_t k = 0; k < n; k++, pos += 2) {
+    uint16_t code = (data[pos] << 8) | data[pos + 1];
+    if (code == 0) continue; // Заполнитель P0000
+
+    uint8_t i = 0;
+    while (i < store->count && store->dtc[i].code != code) i++;
+    if (i == store->count) {
+      if (store->count >= OBD_DTC_MAX) {
+        store->overflow = 1;
+        continue;
+      }
+      store->dtc[i].code = code;
+      store->dtc[i].kinds = 0;
+      store->count++;
+    }
+    store->dtc[i].kinds |= kind;
+  }
+
+  // Коды, не подтвержденные ни одним режимом, убираем с сохранением порядка
+  uint8_t out = 0;
+  for (uint8_t i = 0; i < store->count; i++) {
+    if (store->dtc[i].kinds) store->dtc[out++] = store->dtc[i];
+  }
+  store->count = out;
+  store->changes++;
+  return n;
+}
+
+void OBD_DTC_On_List(const OBD_Signal *sig)
+{
+  OBD_DTC_Store *store = sig->context;
+
+  if (sig->state != OBD_SIG_VALID || !sig->payload) return;
+  OBD_DTC_Parse(store, sig->service, sig->payload, sig->payload_len);
+}
+
+void OBD_DTC_On_Status(const OBD_Signal *sig)
+{
+  OBD_DTC_Store *store = sig->context;
+  int32_t mil, count;
+
+  if (sig->state != OBD_SIG_VALID) return;
+  if (!OBD_PID_Get(0x01, 0, sig->data, sig->len, &mil) ||
+      !OBD_PID_Get(0x01, 1, sig->data, sig->len, &count)) return;
+
+  // Первый статус только запоминаем: при старте списки запрашиваются и так
+  uint8_t changed = store->status_valid && (mil != store->mil || count != store->reported);
+  store->mil = mil;
+  store->reported = count;
+  store->status_valid = 1;
+  if (!changed) return;
+
+  for (uint8_t i = 0; i < sizeof(store->fetch) / sizeof(store->fetch[0]); i++) {
+    if (store->fetch[i]) OBD_Sched_Request(store->fetch[i]);
+  }
+}
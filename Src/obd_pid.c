@@ -0,0 +1,239 @@
+#include "main.h"
+#include "obd_pid.h"
+#ifdef DEBUG
+#include "mcp2515.h"
+#endif
+
+// Длины данных PID Mode 01 (SAE J1979), 0 - длина не фиксирована/неизвестна
+static const uint8_t pid_length[] = {
+  /* 0x00 */ 4, 4, 2, 2, 1, 1, 1, 1, 1, 1, 1, 1, 2, 1, 1, 1,
+  /* 0x10 */ 2, 1, 1, 1, 2, 2, 2, 2, 2, 2, 2, 2, 1, 1, 1, 2,
+  /* 0x20 */ 4, 2, 2, 2, 4, 4, 4, 4, 4, 4, 4, 4, 1, 1, 1, 1,
+  /* 0x30 */ 1, 2, 2, 1, 4, 4, 4, 4, 4, 4, 4, 4, 2, 2, 2, 2,
+  /* 0x40 */ 4, 4, 2, 2, 2, 1, 1, 1, 1, 1, 1, 1, 1, 2, 2, 4,
+  /* 0x50 */ 4, 1, 1, 2, 2, 2, 2, 2, 2, 2, 1, 1, 1, 2, 2, 1,
+  /* 0x60 */ 4, 1, 1, 2,
+};
+
+// Поле из целых байтов: raw * num / den + offset, decimals знаков после запятой
+#define PID_F(pid, pos, bytes, num, den, offset, dec, unit, name) \
+  { pid, pos, bytes, 0, (bytes) * 8, 0, OBD_UNIT_##unit, dec, num, den, offset, name }
+#define PID_S(pid, pos, bytes, num, den, offset, dec, unit, name) \
+  { pid, pos, bytes, 0, (bytes) * 8, OBD_PID_SIGNED, OBD_UNIT_##unit, dec, num, den, offset, name }
+// Битовое поле байта pos без масштаба
+#define PID_B(pid, pos, shift, bits, unit, name) \
+  { pid, pos, 1, shift, bits, 0, OBD_UNIT_##unit, 0, 1, 1, 0, name }
+
+// Типовые формулы J1979
+#define PID_PCT(pid, pos, name)   PID_F(pid, pos, 1, 1000, 255, 0, 1, PERCENT, name)     // A*100/255 %
+#define PID_TRIM(pid, pos, name)  PID_F(pid, pos, 1, 1000, 128, -1000, 1, PERCENT, name) // (A-128)*100/128 %
+#define PID_TEMP(pid, pos, name)  PID_F(pid, pos, 1, 1, 1, -40, 0, DEG_C, name)          // A-40 °C
+#define PID_LAMBDA(pid, name)     PID_F(pid, 0, 2, 625, 2048, 0, 4, RATIO, name)         // AB*2/65536
+#define PID_O2_NB(pid) \
+  PID_F(pid, 0, 1, 5, 1, 0, 3, V, "O2 voltage"), PID_TRIM(pid, 1, "O2 fuel trim")
+#define PID_O2_WB_V(pid) \
+  PID_LAMBDA(pid, "O2 lambda"), PID_F(pid, 2, 2, 125, 1024, 0, 3, V, "O2 voltage")
+#define PID_O2_WB_I(pid) \
+  PID_LAMBDA(pid, "O2 lambda"), PID_F(pid, 2, 2, 125, 32, -128000, 3, MA, "O2 current")
+
+// Поля PID по возрастанию номера; PID 0x00, 0x20, ... - карты поддержки (OBD_Set_Supported)
+static const OBD_PID_Field pid_fields[] = {
+  PID_B(0x01, 0, 7, 1, NONE, "MIL"),
+  PID_B(0x01, 0, 0, 7, COUNT, "DTC count"),
+  PID_B(0x01, 1, 0, 8, NONE, "Monitors B"),
+  PID_B(0x01, 2, 0, 8, NONE, "Monitors C"),
+  PID_B(0x01, 3, 0, 8, NONE, "Monitors D"),
+  PID_F(0x02, 0, 2, 1, 1, 0, 0, DTC, "Freeze frame DTC"),
+  PID_B(0x03, 0, 0, 8, NONE, "Fuel system 1"),
+  PID_B(0x03, 1, 0, 8, NONE, "Fuel system 2"),
+  PID_PCT(0x04, 0, "Engine load"),
+  PID_TEMP(0x05, 0, "Coolant"),
+  PID_TRIM(0x06, 0, "STFT bank 1"),
+  PID_TRIM(0x07, 0, "LTFT bank 1"),
+  PID_TRIM(0x08, 0, "STFT bank 2"),
+  PID_TRIM(0x09, 0, "LTFT bank 2"),
+  PID_F(0x0A, 0, 1, 3, 1, 0, 0, KPA, "Fuel pressure"),
+  PID_F(0x0B, 0, 1, 1, 1, 0, 0, KPA, "Intake MAP"),
+  PID_F(0x0C, 0, 2, 25, 1, 0, 2, RPM, "Engine RPM"),
+  PID_F(0x0D, 0, 1, 1, 1, 0, 0, KMH, "Speed"),
+  PID_F(0x0E, 0, 1, 5, 1, -640, 1, DEG, "Timing advance"),
+  PID_TEMP(0x0F, 0, "Intake air"),
+  PID_F(0x10, 0, 2, 1, 1, 0, 2, GS, "MAF"),
+  PID_PCT(0x11, 0, "Throttle"),
+  PID_B(0x12, 0, 0, 8, NONE, "Secondary air"),
+  PID_B(0x13, 0, 0, 8, NONE, "O2 sensors present"),
+  PID_O2_NB(0x14), PID_O2_NB(0x15), PID_O2_NB(0x16), PID_O2_NB(0x17),
+  PID_O2_NB(0x18), PID_O2_NB(0x19), PID_O2_NB(0x1A), PID_O2_NB(0x1B),
+  PID_B(0x1C, 0, 0, 8, NONE, "OBD standard"),
+  PID_B(0x1D, 0, 0, 8, NONE, "O2 sensors present (4 banks)"),
+  PID_B(0x1E, 0, 0, 1, NONE, "PTO active"),
+  PID_F(0x1F, 0, 2, 1, 1, 0, 0, S, "Run time"),
+  PID_F(0x21, 0, 2, 1, 1, 0, 0, KM, "Distance with MIL"),
+  PID_F(0x22, 0, 2, 79, 1, 0, 3, KPA, "Fuel rail pressure (rel)"),
+  PID_F(0x23, 0, 2, 10, 1, 0, 0, KPA, "Fuel rail pressure"),
+  PID_O2_WB_V(0x24), PID_O2_WB_V(0x25), PID_O2_WB_V(0x26), PID_O2_WB_V(0x27),
+  PID_O2_WB_V(0x28), PID_O2_WB_V(0x29), PID_O2_WB_V(0x2A), PID_O2_WB_V(0x2B),
+  PID_PCT(0x2C, 0, "Commanded EGR"),
+  PID_TRIM(0x2D, 0, "EGR error"),
+  PID_PCT(0x2E, 0, "Evap purge"),
+  PID_PCT(0x2F, 0, "Fuel level"),
+  PID_F(0x30, 0, 1, 1, 1, 0, 0, COUNT, "Warm-ups since clear"),
+  PID_F(0x31, 0, 2, 1, 1, 0, 0, KM, "Distance since clear"),
+  PID_S(0x32, 0, 2, 25, 1, 0, 2, PA, "Evap vapor pressure"),
+  PID_F(0x33, 0, 1, 1, 1, 0, 0, KPA, "Barometric pressure"),
+  PID_O2_WB_I(0x34), PID_O2_WB_I(0x35), PID_O2_WB_I(0x36), PID_O2_WB_I(0x37),
+  PID_O2_WB_I(0x38), PID_O2_WB_I(0x39), PID_O2_WB_I(0x3A), PID_O2_WB_I(0x3B),
+  PID_F(0x3C, 0, 2, 1, 1, -400, 1, DEG_C, "Catalyst B1S1"),
+  PID_F(0x3D, 0, 2, 1, 1, -400, 1, DEG_C, "Catalyst B2S1"),
+  PID_F(0x3E, 0, 2, 1, 1, -400, 1, DEG_C, "Catalyst B1S2"),
+  PID_F(0x3F, 0, 2, 1, 1, -400, 1, DEG_C, "Catalyst B2S2"),
+  PID_F(0x41, 0, 4, 1, 1, 0, 0, NONE, "Monitor status this cycle"),
+  PID_F(0x42, 0, 2, 1, 1, 0, 3, V, "Module voltage"),
+  PID_F(0x43, 0, 2, 1000, 255, 0, 1, PERCENT, "Absolute load"),
+  PID_LAMBDA(0x44, "Commanded lambda"),
+  PID_PCT(0x45, 0, "Relative throttle"),
+  PID_TEMP(0x46, 0, "Ambient air"),
+  PID_PCT(0x47, 0, "Throttle B"),
+  PID_PCT(0x48, 0, "Throttle C"),
+  PID_PCT(0x49, 0, "Pedal D"),
+  PID_PCT(0x4A, 0, "Pedal E"),
+  PID_PCT(0x4B, 0, "Pedal F"),
+  PID_PCT(0x4C, 0, "Commanded throttle"),
+  PID_F(0x4D, 0, 2, 1, 1, 0, 0, MIN, "Time with MIL"),
+  PID_F(0x4E, 0, 2, 1, 1, 0, 0, MIN, "Time since clear"),
+  PID_F(0x4F, 0, 1, 1, 1, 0, 0, RATIO, "Max lambda"),
+  PID_F(0x4F, 1, 1, 1, 1, 0, 0, V, "Max O2 voltage"),
+  PID_F(0x4F, 2, 1, 1, 1, 0, 0, MA, "Max O2 current"),
+  PID_F(0x4F, 3, 1, 10, 1, 0, 0, KPA, "Max MAP"),
+  PID_F(0x50, 0, 1, 10, 1, 0, 0, GS, "Max MAF"),
+  PID_B(0x51, 0, 0, 8, NONE, "Fuel type"),
+  PID_PCT(0x52, 0, "Ethanol"),
+  PID_F(0x53, 0, 2, 5, 1, 0, 3, KPA, "Evap pressure (abs)"),
+  PID_S(0x54, 0, 2, 1, 1, 0, 0, PA, "Evap pressure"),
+  PID_TRIM(0x55, 0, "Secondary O2 STFT bank 1"),
+  PID_TRIM(0x55, 1, "Secondary O2 STFT bank 3"),
+  PID_TRIM(0x56, 0, "Secondary O2 LTFT bank 1"),
+  PID_TRIM(0x56, 1, "Secondary O2 LTFT bank 3"),
+  PID_TRIM(0x57, 0, "Secondary O2 STFT bank 2"),
+  PID_TRIM(0x57, 1, "Secondary O2 STFT bank 4"),
+  PID_TRIM(0x58, 0, "Secondary O2 LTFT bank 2"),
+  PID_TRIM(0x58, 1, "Secondary O2 LTFT bank 4"),
+  PID_F(0x59, 0, 2, 10, 1, 0, 0, KPA, "Fuel rail pressure (abs)"),
+  PID_PCT(0x5A, 0, "Relative pedal"),
+  PID_PCT(0x5B, 0, "Hybrid battery life"),
+  PID_TEMP(0x5C, 0, "Oil"),
+  PID_F(0x5D, 0, 2, 25, 32, -21000, 2, DEG, "Injection timing"),
+  PID_F(0x5E, 0, 2, 5, 1, 0, 2, LH, "Fuel rate"),
+  PID_B(0x5F, 0, 0, 8, NONE, "Emission requirements"),
+  PID_F(0x61, 0, 1, 1, 1, -125, 0, PERCENT, "Demand torque"),
+  PID_F(0x62, 0, 1, 1, 1, -125, 0, PERCENT, "Actual torque"),
+  PID_F(0x63, 0, 2, 1, 1, 0, 0, NM, "Reference torque"),
+};
+
+#define PID_FIELD_COUNT  (sizeof(pid_fields) / sizeof(pid_fields[0]))
+
+static const char *const unit_names[] = {
+  "", "", "%", "C", "kPa", "Pa", "rpm", "km/h", "deg", "g/s",
+  "V", "mA", "lambda", "s", "min", "km", "L/h", "Nm", "",
+};
+
+uint8_t OBD_PID_Length(uint8_t pid)
+{
+  return pid < sizeof(pid_length) ? pid_length[pid] : 0;
+}
+
+const OBD_PID_Field *OBD_PID_Fields(uint8_t pid, uint8_t *count)
+{
+  // Двоичный поиск первого поля PID
+  uint16_t lo = 0, hi = PID_FIELD_COUNT;
+  while (lo < hi) {
+    uint16_t mid = (lo + hi) / 2;
+    if (pid_fields[mid].pid < pid) lo = mid + 1;
+    else hi = mid;
+  }
+
+  uint8_t n = 0;
+  while (lo + n < PID_FIELD_COUNT && pid_fields[lo + n].pid == pid) n++;
+  *count = n;
+  return n ? &pid_fields[lo] : NULL;
+}
+
+int32_t OBD_PID_Decode(const OBD_PID_Field *field, const uint8_t *data)
+{
+  const uint8_t *p = &data[field->pos];
+  uint32_t raw = p[0];
+  int32_t value;
+
+  for (uint8_t i = 1; i < field->bytes; i++) raw = (raw << 8) | p[i];
+  raw >>= field->shift;
+  if (field->bits < 32) raw &= (1u << field->bits) - 1;
+
+  if (field->flags & OBD_PID_SIGNED) {
+    value = (int32_t)(raw << (32 - field->bits)) >> (32 - field->bits);
+  } else {
+    value = (int32_t)raw;
+  }
+  // Без деления, где масштаб целый (UDIV/SDIV на Cortex-M - 2-12 тактов, но все же)
+  if (field->den == 1) return value * field->num + field->offset;
+  return value * field->num / field->den + field->offset;
+}
+
+uint8_t OBD_PID_Get(uint8_t pid, uint8_t index, const uint8_t *data, uint8_t len, int32_t *value)
+{
+  uint8_t count;
+  const OBD_PID_Field *field = OBD_PID_Fields(pid, &count);
+
+  if (index >= count || len < field[index].pos + field[index].bytes) return 0;
+  *value = OBD_PID_Decode(&field[index], data);
+  return 1;
+}
+
+const char *OBD_Unit_Name(uint8_t unit)
+{
+  return unit < sizeof(unit_names) / sizeof(unit_names[0]) ? unit_names[unit] : "";
+}
+
+#ifdef DEBUG
+uint32_t OBD_PID_Self_Test(void)
+{
+  uint8_t frame[8] = {0x06, 0x41, 0, 0, 0, 0, 0, 0};
+  uint32_t errors = 0;
+  int32_t value;
+
+  // Проверка порядка таблицы: от него зависит двоичный поиск
+  for (uint16_t i = 1; i < PID_FIELD_COUNT; i++) {
+    if (pid_fields[i].pid < pid_fields[i - 1].pid) errors++;
+  }
+
+  frame[2] = PID_ENGINE_RPM;
+  for (uint32_t ab = 0; ab <= 0xFFFF; ab++) {
+    frame[3] = ab >> 8;
+    frame[4] = (uint8_t)ab;
+    OBD_PID_Get(PID_ENGINE_RPM, 0, &frame[3], 2, &value);
+    if (value != (int32_t)(Parse_Engine_RPM(frame, 8) * 100.0)) errors++;
+  }
+
+  frame[2] = PID_COOLANT_TEMP;
+  for (uint16_t a = 0; a <= 0xFF; a++) {
+    frame[3] = a;
+    OBD_PID_Get(PID_COOLANT_TEMP, 0, &frame[3], 1, &value);
+    if (value != (int32_t)Parse_Coolant_Temperature(frame, 8)) errors++;
+  }
+
+  frame[2] = PID_DTC_STATUS;
+  for (uint16_t a = 0; a <= 0xFF; a++) {
+    frame[3] = a;
+    frame[4] = ~a;
+    frame[5] = a ^ 0x5A;
+    DTC_Status status = Parse_DTC_Status(frame, 8);
+    int32_t mil, count, tests, completion;
+    OBD_PID_Get(PID_DTC_STATUS, 0, &frame[3], 4, &mil);
+    OBD_PID_Get(PID_DTC_STATUS, 1, &frame[3], 4, &count);
+    OBD_PID_Get(PID_DTC_STATUS, 2, &frame[3], 4, &tests);
+    OBD_PID_Get(PID_DTC_STATUS, 3, &frame[3], 4, &completion);
+    if (mil != status.mil_status || count != status.dtc_count ||
+        tests != status.supported_tests || completion != status.test_completion) errors++;
+  }
+  return errors;
+}
+#endif
@@ -0,0 +1,635 @@
+#include "main.h"
+#include "obd_sched.h"
+#include <string.h>
+
+// Служебные запросы ECU (OBD_Sched_ECU.control)
+#define OBD_CTRL_NONE      0  // Запрос по сигналам e->sig
+#define OBD_CTRL_DISCOVER  1  // PID диапазона e->disc_pid
+#define OBD_CTRL_SESSION   2  // DiagnosticSessionControl e->session
+
+void OBD_Sched_Init(OBD_Sched *sched, OBD_Signal *signals, uint8_t count)
+{
+  uint32_t now = HAL_GetTick();
+
+  memset(sched, 0, sizeof(*sched));
+  sched->signals = signals;
+  sched->signal_count = count;
+  for (uint8_t i = 0; i < count; i++) {
+    signals[i].state = OBD_SIG_NONE;
+    signals[i].pending = 0;
+    signals[i].solo = 0;
+    signals[i].request = 0;
+    signals[i].payload = NULL;
+    signals[i].due = now;
+    signals[i].interval_ms = signals[i].period_ms;
+    signals[i].achieved_ms = 0;
+    signals[i].updates = 0;
+  }
+}
+
+uint8_t OBD_Sched_Add_ECU(OBD_Sched *sched, uint8_t extended, uint8_t ecu)
+{
+  if (sched->ecu_count >= OBD_SCHED_MAX_ECUS) return 0xFF;
+  OBD_Sched_ECU *e = &sched->ecu[sched->ecu_count];
+  memset(e, 0, sizeof(*e));
+  OBD_Init_Physical(&e->client, extended, ecu);
+  if (!extended) {
+    uint16_t slot = CAN_Dispatch_Std(e->client.link.rx_id);
+    if (CAN_DISPATCH_HANDLER(slot) == CAN_DISPATCH_ISOTP) sched->isotp_ecu[CAN_DISPATCH_ARG(slot)] = sched->ecu_count + 1;
+    else sched->std_scan = 1;
+  }
+  e->client.vehicle_key = sched->vehicle_key;
+  e->discovering = !(sched->vehicle_key && OBD_Cache_Load(&e->client));
+  e->disc_pid = 0x00;
+  e->session = e->session_active = UDS_SESSION_DEFAULT;
+  e->p2_star_ms = UDS_P2_STAR_MS;
+  return sched->ecu_count++;
+}
+
+void OBD_Sched_Set_Session(OBD_Sched *sched, uint8_t ecu, uint8_t session)
+{
+  if (ecu < sched->ecu_count) sched->ecu[ecu].session = session;
+}
+
+/**
+  * @brief  Данные PID диапазона e->disc_pid в карту поддерживаемых PID.
+  *         После PID 0x00 карта может найтись в кэше - остальное не спрашиваем.
+  */
+static void OBD_Sched_Range(OBD_Sched_ECU *e, const uint8_t *data)
+{
+  uint8_t next = OBD_Set_Supported(&e->client, e->disc_pid, data);
+  if (e->disc_pid == 0x00 && OBD_Cache_Load(&e->client)) {
+    e->discovering = 0;
+    return;
+  }
+  e->disc_pid = next;
+  if (!next) {
+    e->discovering = 0;
+    OBD_Cache_Store(&e->client);
+  }
+}
+
+uint8_t OBD_Sched_Add_Found(OBD_Sched *sched, uint8_t extended, const OBD_ECU_Info *info)
+{
+  uint8_t index = OBD_Sched_Add_ECU(sched, extended, info->ecu);
+  if (index != 0xFF) sched->ecu[index].client.wwh = info->wwh;
+  if (index != 0xFF && sched->ecu[index].discovering) {
+    OBD_Sched_Range(&sched->ecu[index], info->supported); // PID 0x00 уже есть
+  }
+  return index;
+}
+
+/**
+  * @brief  Завершение сигнала: новое значение или ошибка, следующий крайний срок.
+  *         Период планирования не короче времени ответа ECU (чаще он все равно
+  *         не успеет); ошибки удваивают период до OBD_BACKOFF_MAX_MS, успешные
+  *         ответы постепенно возвращают его к желаемому.
+  */
+static void OBD_Signal_Done(OBD_Signal *sig, OBD_Signal_State state, const OBD_Sched_ECU *e,
+                            uint32_t now)
+{
+  uint16_t floor = sig->period_ms > e->rtt_ms ? sig->period_ms : e->rtt_ms;
+
+  sig->state = state;
+  sig->pending = 0;
+  sig->request = 0;
+  if (state == OBD_SIG_VALID) {
+    if (sig->updates) {
+      uint32_t gap = now - sig->updated;
+      if (gap > 0xFFFF) gap = 0xFFFF;
+      sig->achieved_ms = sig->achieved_ms ? (sig->achieved_ms * 3 + gap) / 4 : gap;
+    }
+    sig->updates++;
+    sig->updated = now;
+
+    if (sig->interval_ms > floor) sig->interval_ms -= (sig->interval_ms - floor + 3) / 4;
+    else sig->interval_ms = floor;
+
+    // Срок от прошлого срока, а не от ответа - период не плывет на время ответа.
+    // Опоздали на целый период - следующий запрос сразу, без серии догоняющих.
+    sig->due += sig->interval_ms;
+    if ((int32_t)(now - sig->due) > 0) sig->due = now;
+  } else {
+    uint32_t backoff = (uint32_t)sig->interval_ms * 2;
+    if (backoff < floor) backoff = floor;
+    if (backoff > OBD_BACKOFF_MAX_MS) backoff = OBD_BACKOFF_MAX_MS;
+    sig->interval_ms = backoff;
+    sig->due = now + sig->interval_ms;
+  }
+  if (sig->on_update) sig->on_update(sig);
+  sig->payload = NULL;
+}
+
+// Границы корзин: по 1 мс для быстрых ECU, дальше шаг растет
+static const uint16_t latency_bin_max[OBD_LAT_BINS] = {
+  1, 2, 3, 4, 5, 6, 8, 10, 12, 16, 20, 25, 32, 40, 50, 0xFFFF
+};
+
+uint16_t OBD_Latency_Bin_Max(uint8_t bin)
+{
+  return bin < OBD_LAT_BINS ? latency_bin_max[bin] : 0xFFFF;
+}
+
+/**
+  * @brief  Новая выборка задержки и пересчет таймаута по процентилю.
+  */
+static void OBD_Latency_Add(OBD_Latency *lat, uint32_t ms)
+{
+  uint8_t bin = 0;
+
+  while (bin < OBD_LAT_BINS - 1 && ms > latency_bin_max[bin]) bin++;
+  if (lat->total >= OBD_LAT_WINDOW) {
+    // Скользящее окно: старые выборки весят вдвое меньше с каждым заполнением
+    lat->total = 0;
+    for (uint8_t i = 0; i < OBD_LAT_BINS; i++) {
+      lat->bins[i] /= 2;
+      lat->total += lat->bins[i];
+    }
+  }
+  lat->bins[bin]++;
+  lat->total++;
+
+  lat->timeout_ms = 0;
+  if (lat->total < OBD_LAT_MIN_SAMPLES) return;
+  uint32_t need = ((uint32_t)lat->total * OBD_LAT_PERCENTILE + 99) / 100;
+  uint32_t sum = 0;
+  for (bin = 0; bin < OBD_LAT_BINS - 1; bin++) {
+    sum += lat->bins[bin];
+    if (sum >= need) break;
+  }
+  if (bin < OBD_LAT_BINS - 1) lat->timeout_ms = latency_bin_max[bin] + OBD_LAT_MARGIN_MS;
+}
+
+/**
+  * @brief  Таймаут запроса в полете: самый долгий из выученных для его
+  *         сигналов (для служебных - по ECU), не больше полного.
+  */
+static uint32_t OBD_Sched_Timeout(const OBD_Sched *sched, const OBD_Sched_ECU *e)
+{
+  uint32_t full = e->client.timeout_ms;
+  uint32_t timeout = e->latency.timeout_ms;
+
+  if (e->control == OBD_CTRL_NONE) {
+    for (uint8_t k = 0; k < e->count; k++) {
+      uint16_t t = sched->signals[e->sig[k]].latency.timeout_ms;
+      if (t == 0) return full;
+      if (k == 0 || t > timeout) timeout = t;
+    }
+  }
+  return (timeout == 0 || timeout > full) ? full : timeout;
+}
+
+/**
+  * @brief  Выборка задержки запроса в полете; ответа нет - выборка на полном таймауте.
+  */
+static void OBD_Sched_Latency(OBD_Sched *sched, OBD_Sched_ECU *e, uint32_t ms)
+{
+  OBD_Latency_Add(&e->latency, ms);
+  if (e->control != OBD_CTRL_NONE) return;
+  for (uint8_t k = 0; k < e->count; k++) OBD_Latency_Add(&sched->signals[e->sig[k]].latency, ms);
+}
+
+void OBD_Sched_Request(OBD_Signal *sig)
+{
+  sig->due = HAL_GetTick();
+  sig->request = 1;
+}
+
+/**
+  * @brief  Сервисы Mode 03/04/07/0A идут без PID
+  */
+static uint8_t OBD_Service_Has_PID(uint8_t service)
+{
+  return !(service == 0x03 || service == 0x04 || service == 0x07 || service == 0x0A);
+}
+
+/**
+  * @brief  Сигнал нельзя объединить с другими: длина ответа неизвестна
+  *         или в составном ответе он не пришел
+  */
+static uint8_t OBD_Signal_Alone(const OBD_Signal *s)
+{
+  if (s->service == 0x01) return s->solo || OBD_PID_Length(s->pid) == 0;
+  if (s->service == UDS_SID_RDBI) return s->solo || s->did_len == 0;
+  return 1;
+}
+
+/**
+  * @brief  Сколько сигналов сервиса можно объединить в запросе к ECU
+  */
+static uint8_t OBD_Sched_Batch_Limit(const OBD_Sched_ECU *e)
+{
+  if (e->service == 0x01) return OBD_PID_Batch(&e->client);
+  if (e->service == UDS_SID_RDBI) return e->client.multi_did ? UDS_RDBI_MAX_DIDS : 1;
+  return 1;
+}
+
+/**
+  * @brief  SID запроса в полете: Mode 01 у ECU ISO 27145 идет сервисом 0x22
+  */
+static uint8_t OBD_Sched_SID(const OBD_Sched_ECU *e)
+{
+  return e->service == 0x01 ? OBD_PID_SERVICE(&e->client) : e->service;
+}
+
+/**
+  * @brief  Составной запрос не удался - дальше сервис по одному сигналу
+  */
+static void OBD_Sched_No_Batch(OBD_Sched_ECU *e)
+{
+  if (e->service == UDS_SID_RDBI) e->client.multi_did = 0;
+  else e->client.multi_pid = 0;
+}
+
+uint16_t OBD_Signal_Rate_x10(const OBD_Signal *sig)
+{
+  if (sig->achieved_ms == 0) return 0;
+  return 10000u / sig->achieved_ms;
+}
+
+/**
+  * @brief  Отправка запроса по сигналам, отмеченным в e->sig.
+  * @retval 1 - запрос ушел в ISO-TP, 0 - канал или очередь передачи заняты
+  */
+static uint8_t OBD_Sched_Send(OBD_Sched *sched, OBD_Sched_ECU *e, uint32_t now)
+{
+  uint8_t req[1 + 2 * OBD_MAX_PIDS_PER_REQUEST];
+  uint8_t len = 1;
+
+  req[0] = e->service;
+  if (e->control == OBD_CTRL_DISCOVER) {
+    len = OBD_Build_Request(&e->client, &e->disc_pid, 1, req);
+  } else if (e->control == OBD_CTRL_SESSION) {
+    req[len++] = e->session;
+  } else if (e->service == UDS_SID_RDBI) {
+    for (uint8_t k = 0; k < e->count; k++) {
+      req[len++] = sched->signals[e->sig[k]].did >> 8;
+      req[len++] = (uint8_t)sched->signals[e->sig[k]].did;
+    }
+  } else if (e->service == 0x01) {
+    uint8_t pids[OBD_MAX_PIDS_PER_REQUEST];
+    for (uint8_t k = 0; k < e->count; k++) pids[k] = sched->signals[e->sig[k]].pid;
+    len = OBD_Build_Request(&e->client, pids, e->count, req);
+  } else if (OBD_Service_Has_PID(e->service)) {
+    for (uint8_t k = 0; k < e->count; k++) req[len++] = sched->signals[e->sig[k]].pid;
+  }
+  if (!ISOTP_Send(&e->client.link, req, len)) return 0;
+  e->sent = now;
+  e->tester_tick = now;
+  e->deadline = now + OBD_Sched_Timeout(sched, e);
+  return 1;
+}
+
+/**
+  * @brief  Выбор сигналов, которым пора обновиться, по возрастанию крайнего
+  *         срока (EDF): первым - самый просроченный. Mode 01 объединяется
+  *         до 6 PID, 0x22 - до UDS_RDBI_MAX_DIDS DID (если ECU это умеет),
+  *         остальные сервисы - по одному. Смена сессии и опрос PID - раньше сигналов.
+  */
+static void OBD_Sched_Next(OBD_Sched *sched, uint8_t ecu, uint32_t now)
+{
+  OBD_Sched_ECU *e = &sched->ecu[ecu];
+  uint8_t limit = 1; // До выбора первого сигнала сервис неизвестен
+
+  e->count = 0;
+  e->control = OBD_CTRL_NONE;
+  if (e->session != e->session_active || e->discovering) {
+    if (e->session != e->session_active) {
+      e->control = OBD_CTRL_SESSION;
+      e->service = UDS_SID_DSC;
+    } else {
+      if ((int32_t)(now - e->deadline) < 0) return; // ECU молчал - пауза
+      e->control = OBD_CTRL_DISCOVER;
+      e->service = 0x01;
+    }
+    if (OBD_Sched_Send(sched, e, now)) {
+      e->retries = 0;
+      e->busy = 1;
+    }
+    return;
+  }
+
+  while (e->count < limit) {
+    OBD_Signal *best = NULL;
+    uint8_t best_i = 0, best_alone = 0;
+
+    for (uint8_t i = 0; i < sched->signal_count; i++) {
+      OBD_Signal *s = &sched->signals[i];
+      if (s->ecu != ecu || s->pending || s->state == OBD_SIG_UNSUPPORTED) continue;
+      if (s->period_ms == 0 && s->state != OBD_SIG_NONE && !s->request) continue; // Однократный уже получен
+      if (s->service == 0x01 && !OBD_PID_Supported(&e->client, s->pid)) {
+        OBD_Signal_Done(s, OBD_SIG_UNSUPPORTED, e, now); // Нет в карте - не спрашиваем
+        continue;
+      }
+      if ((int32_t)(now - s->due) < 0) continue;
+
+      // Одиночные: другие сервисы, длина неизвестна, не пришедшие в составном ответе
+      uint8_t alone = OBD_Signal_Alone(s);
+      if (e->count > 0 && (alone || s->service != e->service)) continue;
+      if (best && (int32_t)(s->due - best->due) >= 0) continue;
+
+      best = s;
+      best_i = i;
+      best_alone = alone;
+    }
+    if (!best) break;
+
+    best->pending = 1; // Выбран - в следующем круге не участвует
+    e->service = best->service;
+    e->sig[e->count++] = best_i;
+    if (best_alone) break;
+    if (e->count == 1) limit = OBD_Sched_Batch_Limit(e);
+  }
+  if (e->count == 0) return;
+
+  if (!OBD_Sched_Send(sched, e, now)) {
+    // Повторим на следующем проходе
+    for (uint8_t k = 0; k < e->count; k++) sched->signals[e->sig[k]].pending = 0;
+    return;
+  }
+  e->retries = 0;
+  e->busy = 1;
+}
+
+/**
+  * @brief  Учет времени ответа ECU (скользящее среднее 1/8) и гистограмм
+  *         задержки. После NRC 0x78 в него попадает и ожидание - ECU
+  *         действительно не успевает.
+  */
+static void OBD_Sched_RTT(OBD_Sched *sched, OBD_Sched_ECU *e, uint32_t now)
+{
+  uint32_t rtt = now - e->sent;
+  OBD_Sched_Latency(sched, e, rtt);
+  if (rtt > 0xFFFF) rtt = 0xFFFF;
+  e->rtt_ms = e->rtt_ms ? (e->rtt_ms * 7 + rtt) / 8 : rtt;
+}
+
+/**
+  * @brief  Учет отрицательного ответа в статистике ECU
+  */
+static void OBD_Sched_Count_NRC(OBD_Sched_ECU *e, uint8_t sid, uint8_t nrc)
+{
+  uint8_t i = 0;
+
+  while (i < e->nrc_count && (e->nrc_stats[i].sid != sid || e->nrc_stats[i].nrc != nrc)) i++;
+  if (i == e->nrc_count) {
+    if (e->nrc_count >= OBD_NRC_STATS) {
+      if (e->nrc_lost < 0xFFFF) e->nrc_lost++;
+      return;
+    }
+    e->nrc_stats[i].sid = sid;
+    e->nrc_stats[i].nrc = nrc;
+    e->nrc_stats[i].count = 0;
+    e->nrc_count++;
+  }
+  if (e->nrc_stats[i].count < 0xFFFF) e->nrc_stats[i].count++;
+}
+
+/**
+  * @brief  Ответ на PID диапазона при опросе поддерживаемых PID.
+  * @retval 0 - положительный ответ не на этот диапазон (опоздавший), ждем дальше
+  */
+static uint8_t OBD_Sched_Discovered(OBD_Sched_ECU *e, UDS_Resp_Class cls, const uint8_t *resp, uint16_t len)
+{
+  OBD_PID_Value range = {.pid = e->disc_pid};
+
+  if (cls == UDS_RESP_POSITIVE &&
+      (OBD_Parse_Response(&e->client, resp, len, &range, 1) != 1 || range.len != 4)) return 0;
+  e->busy = 0;
+  if (cls != UDS_RESP_POSITIVE) {
+    // Отказ: на 0x00 - карта неизвестна (спрашиваем все), дальше - диапазон пуст
+    e->discovering = 0;
+    if (e->client.supported_valid) OBD_Cache_Store(&e->client);
+    return 1;
+  }
+  OBD_Sched_Range(e, range.data);
+  return 1;
+}
+
+/**
+  * @brief  Ответ на DiagnosticSessionControl: P2/P2* из ответа ECU.
+  *         Отказ - остаемся в прежней сессии.
+  * @retval 0 - ответ про другую сессию, ждем дальше
+  */
+static uint8_t OBD_Sched_Session(OBD_Sched_ECU *e, UDS_Resp_Class cls, const uint8_t *resp, uint16_t len)
+{
+  uint16_t p2_ms = 0;
+  uint32_t p2_star_ms = 0;
+
+  if (cls != UDS_RESP_POSITIVE) {
+    e->session = e->session_active;
+    e->busy = 0;
+    return 1;
+  }
+  if (!UDS_Parse_DSC(resp, len, e->session, &p2_ms, &p2_star_ms)) return 0; // Не та сессия - ждем дальше
+
+  e->busy = 0;
+  e->session_active = e->session;
+  if (p2_ms) e->client.timeout_ms = p2_ms > OBD_TIMEOUT_MS ? p2_ms : OBD_TIMEOUT_MS;
+  if (p2_star_ms) e->p2_star_ms = p2_star_ms;
+  return 1;
+}
+
+/**
+  * @brief  Разбор ответа ECU на запрос в полете.
+  */
+static void OBD_Sched_Response(OBD_Sched *sched, OBD_Sched_ECU *e, const uint8_t *resp,
+                               uint16_t len, uint32_t now)
+{
+  uint8_t sid = OBD_Sched_SID(e);
+  UDS_Resp_Class cls = UDS_Classify(resp, len, sid);
+
+  if (cls == UDS_RESP_FOREIGN) return; // Не наш ответ - ждем дальше
+  if (cls != UDS_RESP_POSITIVE) OBD_Sched_Count_NRC(e, sid, resp[2]);
+  if (cls == UDS_RESP_PENDING) {
+    e->deadline = now + e->p2_star_ms; // ECU просит подождать окончательный ответ
+    return;
+  }
+  if (cls != UDS_RESP_POSITIVE) e->client.last_nrc = resp[2];
+
+  // Задержка учитывается только по ответам на запрос в полете
+  if (e->control == OBD_CTRL_DISCOVER) {
+    if (OBD_Sched_Discovered(e, cls, resp, len)) OBD_Sched_RTT(sched, e, now);
+    return;
+  }
+  if (e->control == OBD_CTRL_SESSION) {
+    if (OBD_Sched_Session(e, cls, resp, len)) OBD_Sched_RTT(sched, e, now);
+    return;
+  }
+
+  // Отрицательный ответ на наш сервис
+  if (cls != UDS_RESP_POSITIVE) {
+    uint8_t nrc = resp[2];
+    OBD_Sched_RTT(sched, e, now);
+    e->busy = 0;
+    if (cls == UDS_RESP_SESSION) {
+      // ECU вернулся в сессию по умолчанию (S3) - войдем заново и повторим
+      e->session_active = UDS_SESSION_DEFAULT;
+      if (e->session != UDS_SESSION_DEFAULT) {
+        for (uint8_t k = 0; k < e->count; k++) sched->signals[e->sig[k]].pending = 0;
+        return;
+      }
+    }
+    if (nrc == UDS_NRC_SERVICE_NOT_SUPPORTED) {
+      // Сервиса нет у ECU вовсе - ни один его сигнал больше не спрашиваем
+      for (uint8_t i = 0; i < sched->signal_count; i++) {
+        OBD_Signal *sig = &sched->signals[i];
+        if (&sched->ecu[sig->ecu] != e || sig->service != e->service) continue;
+        sig->nrc = nrc;
+        OBD_Signal_Done(sig, OBD_SIG_UNSUPPORTED, e, now);
+      }
+      return;
+    }
+    if (e->count > 1 && (nrc == UDS_NRC_SUBFUNC_NOT_SUPPORTED || nrc == UDS_NRC_INCORRECT_LENGTH ||
+                         nrc == UDS_NRC_OUT_OF_RANGE)) {
+      // Формат составного запроса отвергнут - дальше по одному, сразу же
+      OBD_Sched_No_Batch(e);
+      for (uint8_t k = 0; k < e->count; k++) sched->signals[e->sig[k]].pending = 0;
+      return;
+    }
+    // Неподдерживаемое (одиночным запросом) больше не спрашиваем, временный отказ
+    // (занят, условия, чужая сессия) - реже, с удвоением периода
+    uint8_t retire = cls == UDS_RESP_UNSUPPORTED && e->count == 1;
+    for (uint8_t k = 0; k < e->count; k++) {
+      OBD_Signal *sig = &sched->signals[e->sig[k]];
+      sig->nrc = nrc;
+      OBD_Signal_Done(sig, retire ? OBD_SIG_UNSUPPORTED : OBD_SIG_ERROR, e, now);
+    }
+    return;
+  }
+
+  OBD_PID_Value values[OBD_MAX_PIDS_PER_REQUEST];
+  uint16_t offsets[OBD_MAX_PIDS_PER_REQUEST] = {0};
+  uint16_t sizes[OBD_MAX_PIDS_PER_REQUEST] = {0};
+  for (uint8_t k = 0; k < e->count; k++) {
+    memset(&values[k], 0, sizeof(values[k]));
+    values[k].pid = sched->signals[e->sig[k]].pid;
+  }
+  if (e->service == 0x01) {
+    OBD_Parse_Response(&e->client, resp, len, values, e->count);
+  } else if (e->service == UDS_SID_RDBI) {
+    uint16_t dids[UDS_RDBI_MAX_DIDS];
+    uint8_t lens[UDS_RDBI_MAX_DIDS];
+    for (uint8_t k = 0; k < e->count; k++) {
+      dids[k] = sched->signals[e->sig[k]].did;
+      lens[k] = sched->signals[e->sig[k]].did_len;
+    }
+    UDS_Parse_RDBI(resp, len, dids, lens, e->count, offsets, sizes);
+  } else if (!OBD_Service_Has_PID(e->service) || (len > 1 && resp[1] == values[0].pid)) {
+    offsets[0] = OBD_Service_Has_PID(e->service) ? 2 : 1;
+    sizes[0] = len - offsets[0];
+  }
+  // Ответ целиком (DID, список DTC, VIN) - приложению в on_update, первые байты - в data
+  for (uint8_t k = 0; k < e->count && e->service != 0x01; k++) {
+    if (!offsets[k]) continue;
+    values[k].len = sizes[k] > OBD_PID_DATA_MAX ? OBD_PID_DATA_MAX : sizes[k];
+    memcpy(values[k].data, &resp[offsets[k]], values[k].len);
+    values[k].valid = 1;
+  }
+
+  // Ни одного PID/DID запроса в полете: ответ на прошлый запрос, опоздавший
+  // за таймаут, или чужой - не ответ на этот, ждем дальше
+  uint8_t matched = 0;
+  for (uint8_t k = 0; k < e->count; k++) matched += values[k].valid;
+  if (!matched) return;
+  OBD_Sched_RTT(sched, e, now);
+
+  e->busy = 0;
+  for (uint8_t k = 0; k < e->count; k++) {
+    OBD_Signal *sig = &sched->signals[e->sig[k]];
+    if (values[k].valid) {
+      if (e->count == 1 && sig->solo) {
+        // Одиночно пришел, в составном - нет: ECU не умеет составные запросы
+        OBD_Sched_No_Batch(e);
+        sig->solo = 0;
+      }
+      sig->len = values[k].len;
+      memcpy(sig->data, values[k].data, values[k].len);
+      sig->payload = offsets[k] ? &resp[offsets[k]] : NULL;
+      sig->payload_len = sizes[k];
+      OBD_Signal_Done(sig, OBD_SIG_VALID, e, now);
+    } else {
+      // В составном ответе не пришел (одиночный без совпадения сюда не доходит) -
+      // переспросим отдельно
+      sig->solo = 1;
+      sig->pending = 0;
+    }
+  }
+}
+
+void OBD_Sched_Task(OBD_Sched *sched)
+{
+  CAN_Frame frame;
+
+  // Кадры раздаются каналам ECU, остальные - приложению (журнал, USB)
+  while (MCP2515_RX_Pop(&frame)) {
+    uint8_t claimed = 0;
+    if (!frame.extended && !sched->std_scan) {
+      // 11 бит: канал ECU по таблице разбора, без перебора по ID
+      uint16_t slot = CAN_Dispatch_Std(frame.id);
+      uint8_t n = CAN_DISPATCH_HANDLER(slot) == CAN_DISPATCH_ISOTP ? sched->isotp_ecu[CAN_DISPATCH_ARG(slot)] : 0;
+      if (n) claimed = ISOTP_On_Frame(&sched->ecu[n - 1].client.link, &frame);
+    } else {
+      for (uint8_t i = 0; i < sched->ecu_count; i++) {
+        claimed |= ISOTP_On_Frame(&sched->ecu[i].client.link, &frame);
+      }
+    }
+    if (!claimed && sched->frame_hook) sched->frame_hook(&frame);
+  }
+
+  uint32_t now = HAL_GetTick();
+  for (uint8_t i = 0; i < sched->ecu_count; i++) {
+    OBD_Sched_ECU *e = &sched->ecu[i];
+    const uint8_t *resp;
+
+    ISOTP_Poll(&e->client.link);
+    uint16_t len = ISOTP_Receive(&e->client.link, &resp);
+    if (len && e->busy) OBD_Sched_Response(sched, e, resp, len, now);
+
+    if (e->busy && e->client.link.rx_state == ISOTP_RX_CF) {
+      e->deadline = now + e->client.timeout_ms; // Идет многокадровый ответ - следит N_Cr
+    }
+    if (e->busy && (int32_t)(now - e->deadline) >= 0) {
+      // Истек выученный таймаут: промах, не ждем полного P2. Опоздавший ответ с другими
+      // PID/DID следующий запрос отбросит. Промах учитывается раз на отправку (как ответ
+      // на полном таймауте): при занятой очереди передачи повтор ждет следующего прохода
+      if (e->retries < OBD_SCHED_RETRIES) {
+        if (OBD_Sched_Send(sched, e, now)) {
+          OBD_Sched_Latency(sched, e, e->client.timeout_ms);
+          e->retries++;
+        }
+        continue;
+      }
+      OBD_Sched_Latency(sched, e, e->client.timeout_ms);
+      if (e->control == OBD_CTRL_SESSION) {
+        e->busy = 0;
+        e->session = e->session_active; // ECU не ответил на смену сессии - остаемся в прежней
+      } else if (e->control == OBD_CTRL_DISCOVER) {
+        // ECU не отвечает на диапазон: на 0x00 - повторим позже, дальше - диапазон пуст
+        e->busy = 0;
+        if (e->disc_pid == 0x00) {
+          e->deadline = now + OBD_DISCOVER_RETRY_MS;
+        } else {
+          e->discovering = 0;
+          OBD_Cache_Store(&e->client);
+        }
+      } else {
+        e->busy = 0;
+        // Нет ответа - временный сбой, повторим с удвоенным периодом
+        for (uint8_t k = 0; k < e->count; k++) OBD_Signal_Done(&sched->signals[e->sig[k]], OBD_SIG_ERROR, e, now);
+      }
+    }
+    if (!e->busy) OBD_Sched_Next(sched, i, now);
+
+    // Вне сессии по умолчанию ECU ждет запросов не дольше S3 - TesterPresent без ответа
+    if (e->session_active != UDS_SESSION_DEFAULT && !e->busy &&
+        (now - e->tester_tick) >= UDS_TESTER_PRESENT_MS && e->client.link.tx_state == ISOTP_IDLE) {
+      uint8_t req[2] = {UDS_SID_TESTER_PRESENT, UDS_SUPPRESS_RESPONSE};
+      if (ISOTP_Send(&e->client.link, req, 2)) e->tester_tick = now;
+    }
+  }
+
+  if (MCP2515_TX_Pending()) {
+    MCP2515_TX_Service(); // Таймауты передачи, если TXnIF так и не пришел
+  }
+}
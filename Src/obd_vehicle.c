@@ -0,0 +1,137 @@
+#include "main.h"
+#include "obd_vehicle.h"
+#include "nvstore.h"
+#include <string.h>
+
+_Static_assert(sizeof(OBD_Vehicle) <= NV_DATA_MAX, "OBD_Vehicle не помещается в запись nvstore");
+
+static OBD_Client vehicle_client; // Канал ISO-TP к ECU двигателя на время подключения (~1 КБ, не на стеке)
+
+/**
+  * @brief  Один запрос Mode 09, для ISO 27145 - DID 0xF8xx сервиса 0x22.
+  * @retval Длина данных после [49 PID] ([62 F8 PID]), 0 - нет ответа
+  */
+static uint16_t OBD_Request_Mode09(OBD_Client *obd, uint8_t pid, uint8_t *resp, uint16_t resp_max,
+                                   const uint8_t **data)
+{
+  uint8_t req[3] = {0x09, pid};
+  uint8_t req_len = 2;
+
+  if (obd->wwh) {
+    req[0] = UDS_SID_RDBI;
+    req[1] = OBD_WWH_DID_INFO >> 8;
+    req[2] = pid;
+    req_len = 3;
+  }
+  uint16_t len = ISOTP_Request(&obd->link, req, req_len, resp, resp_max, obd->timeout_ms);
+  if (len >= 3 && resp[0] == UDS_SID_NEGATIVE && resp[1] == req[0]) {
+    obd->last_nrc = resp[2];
+    return 0;
+  }
+  if (len <= req_len || resp[0] != UDS_POSITIVE(req[0]) || memcmp(&resp[1], &req[1], req_len - 1) != 0) return 0;
+  *data = &resp[req_len];
+  return len - req_len;
+}
+
+uint8_t OBD_Read_VIN(OBD_Client *obd, char *vin)
+{
+  uint8_t resp[4 + OBD_VIN_LEN + 3];
+  const uint8_t *data;
+
+  // [49 02 01 VIN x17] - берем последние 17 байт: часть ECU не шлет счетчик или дополняет VIN спереди
+  uint16_t len = OBD_Request_Mode09(obd, 0x02, resp, sizeof(resp), &data);
+  if (len < OBD_VIN_LEN) return 0;
+  memcpy(vin, &data[len - OBD_VIN_LEN], OBD_VIN_LEN);
+  vin[OBD_VIN_LEN] = '\0';
+  return 1;
+}
+
+uint8_t OBD_Read_Vehicle(OBD_Client *obd, OBD_Vehicle *veh)
+{
+  uint8_t resp[4 + OBD_CALID_MAX * OBD_CALID_LEN];
+  const uint8_t *data;
+  uint16_t len;
+
+  veh->vin[0] = '\0';
+  veh->calid_count = 0;
+  veh->cvn_count = 0;
+  if (!OBD_Read_VIN(obd, veh->vin)) return 0;
+
+  // [49 04 N CALID x16 ...]; у ISO 27145 счетчика N может не быть - он в остатке от деления
+  len = OBD_Request_Mode09(obd, 0x04, resp, sizeof(resp), &data);
+  for (uint16_t pos = len % OBD_CALID_LEN; len && pos + OBD_CALID_LEN <= len && veh->calid_count < OBD_CALID_MAX; pos += OBD_CALID_LEN) {
+    memcpy(veh->calid[veh->calid_count], &data[pos], OBD_CALID_LEN);
+    veh->calid[veh->calid_count++][OBD_CALID_LEN] = '\0';
+  }
+
+  // [49 06 N CVN x4 ...]
+  len = OBD_Request_Mode09(obd, 0x06, resp, sizeof(resp), &data);
+  for (uint16_t pos = len % 4; len && pos + 4 <= len && veh->cvn_count < OBD_CALID_MAX; pos += 4) {
+    veh->cvn[veh->cvn_count++] = ((uint32_t)data[pos] << 24) | ((uint32_t)data[pos + 1] << 16) |
+                                 ((uint32_t)data[pos + 2] << 8) | data[pos + 3];
+  }
+  return 1;
+}
+
+uint32_t OBD_Vehicle_Key(const OBD_Vehicle *veh)
+{
+  if (!veh->vin[0]) return 0;
+  return NV_CRC32(0, veh->vin, OBD_VIN_LEN) | 1; // Не 0: 0 - "ключа нет"
+}
+
+void OBD_Vehicle_Save(const OBD_Vehicle *veh)
+{
+  uint32_t key = OBD_Vehicle_Key(veh);
+
+  if (!key) return;
+  NV_Write(NV_TYPE_VEHICLE, key, veh, sizeof(*veh));
+  NV_Write(NV_TYPE_LAST_VEHICLE, 0, &key, sizeof(key));
+}
+
+/**
+  * @brief  Последний автомобиль на прежней скорости: отвечает ли тем же VIN.
+  */
+static uint8_t OBD_Vehicle_Restore(OBD_Vehicle *veh)
+{
+  uint32_t key;
+
+  if (!NV_Read(NV_TYPE_LAST_VEHICLE, 0, &key, sizeof(key))) return 0;
+  if (!NV_Read(NV_TYPE_VEHICLE, key, veh, sizeof(*veh)) || veh->ecu_count == 0) return 0;
+
+  if (!MCP2515_Set_Bitrate(veh->bitrate)) return 0;
+  if (veh->extended) MCP2515_Init_ISO27145();
+  else MCP2515_Init_ISO15765();
+
+  char vin[OBD_VIN_LEN + 1];
+  OBD_Init_Physical(&vehicle_client, veh->extended, veh->ecus[0].ecu);
+  vehicle_client.wwh = veh->ecus[0].wwh;
+  return OBD_Read_VIN(&vehicle_client, vin) && memcmp(vin, veh->vin, OBD_VIN_LEN) == 0;
+}
+
+uint8_t OBD_Vehicle_Connect(OBD_Vehicle *veh)
+{
+  MCP2515_Detect_Result detect;
+
+  if (OBD_Vehicle_Restore(veh)) return 1;
+
+  memset(veh, 0, sizeof(*veh));
+  veh->bitrate = MCP2515_Init_Auto(&detect) ? detect.bitrate : MCP2515_BITRATE_DEFAULT;
+  veh->extended = detect.extended;
+  veh->ecu_count = OBD_Enumerate_ECUs(veh->extended, veh->ecus, OBD_MAX_ECUS);
+
+  // ECU двигателя первым - у него и спрашиваем VIN
+  uint8_t engine = veh->extended ? 0x10 : 0;
+  for (uint8_t i = 1; i < veh->ecu_count; i++) {
+    if (veh->ecus[i].ecu == engine) {
+      OBD_ECU_Info tmp = veh->ecus[0];
+      veh->ecus[0] = veh->ecus[i];
+      veh->ecus[i] = tmp;
+    }
+  }
+  if (veh->ecu_count) {
+    OBD_Init_Physical(&vehicle_client, veh->extended, veh->ecus[0].ecu);
+    vehicle_client.wwh = veh->ecus[0].wwh;
+    if (OBD_Read_Vehicle(&vehicle_client, veh)) OBD_Vehicle_Save(veh);
+  }
+  return 0;
+}
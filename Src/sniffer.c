@@ -0,0 +1,93 @@
+#include "main.h"
+#include "sniffer.h"
+#include "mcp2515.h"
+#include "usbd_cdc_if.h"
+
+static uint32_t stats_tick;  // HAL_GetTick() последней записи статистики
+
+static uint8_t Put_U32(uint8_t *p, uint32_t value)
+{
+  p[0] = (uint8_t)value;
+  p[1] = (uint8_t)(value >> 8);
+  p[2] = (uint8_t)(value >> 16);
+  p[3] = (uint8_t)(value >> 24);
+  return 4;
+}
+
+/**
+  * @brief  Упаковка кадра в запись потока.
+  * @retval Длина записи
+  */
+static uint8_t Sniffer_Encode_Frame(const CAN_Frame *frame, uint8_t *rec)
+{
+  uint8_t len = 0;
+  uint8_t dlc = frame->rtr ? 0 : frame->dlc;
+
+  rec[len++] = SNIFFER_SYNC;
+  rec[len++] = SNIFFER_TYPE_FRAME | (frame->extended ? SNIFFER_FLAG_EXT : 0) |
+               (frame->rtr ? SNIFFER_FLAG_RTR : 0) | (frame->dlc & 0x0F);
+  len += Put_U32(&rec[len], frame->timestamp);
+  rec[len++] = (uint8_t)frame->id;
+  rec[len++] = (uint8_t)(frame->id >> 8);
+  if (frame->extended) {
+    rec[len++] = (uint8_t)(frame->id >> 16);
+    rec[len++] = (uint8_t)(frame->id >> 24);
+  }
+  for (uint8_t i = 0; i < dlc; i++) rec[len++] = frame->data[i];
+  return len;
+}
+
+/**
+  * @brief  Запись статистики: счетчики приема и потерь на каждом участке.
+  */
+static void Sniffer_Send_Stats(void)
+{
+  uint8_t rec[SNIFFER_RECORD_MAX];
+  uint8_t len = 0;
+  uint32_t bitrate_k = MCP2515_Get_Bitrate() / 1000;
+
+  rec[len++] = SNIFFER_SYNC;
+  rec[len++] = SNIFFER_TYPE_STATS;
+  len += Put_U32(&rec[len], micros());
+  len += Put_U32(&rec[len], mcp2515_stats.rx_frames);
+  len += Put_U32(&rec[len], mcp2515_stats.rx_ring_drops);
+  len += Put_U32(&rec[len], mcp2515_stats.rx_overflow[0] + mcp2515_stats.rx_overflow[1]);
+  len += Put_U32(&rec[len], mcp2515_stats.msg_errors);
+  len += Put_U32(&rec[len], CDC_Stream_Drops());
+  rec[len++] = (uint8_t)bitrate_k;
+  rec[len++] = (uint8_t)(bitrate_k >> 8);
+  CDC_Stream_Write(rec, len);
+}
+
+uint8_t Sniffer_Start(uint32_t bitrate)
+{
+  if (!MCP2515_Set_Bitrate(bitrate)) return 0;
+  MCP2515_Init_Listen_Only();
+  stats_tick = HAL_GetTick();
+  return 1;
+}
+
+void Sniffer_Task(void)
+{
+  uint8_t rec[SNIFFER_RECORD_MAX];
+  CAN_Frame frame;
+
+  // Кадр, не поместившийся в поток, учитывается в CDC_Stream_Drops
+  while (MCP2515_RX_Pop(&frame)) {
+    CDC_Stream_Write(rec, Sniffer_Encode_Frame(&frame, rec));
+  }
+  if ((HAL_GetTick() - stats_tick) >= SNIFFER_STATS_PERIOD_MS) {
+    stats_tick += SNIFFER_STATS_PERIOD_MS;
+    Sniffer_Send_Stats();
+  }
+  CDC_Stream_Flush();
+}
+
+void Sniffer_Run(uint32_t bitrate)
+{
+  Sniffer_Start(bitrate);
+  while (1) {
+    Sniffer_Task();
+    __WFI(); // Следующий кадр (INT), завершение передачи USB или SysTick
+  }
+}
@@ -0,0 +1,79 @@
+#include "main.h"
+#include "uds.h"
+
+UDS_Resp_Class UDS_Classify(const uint8_t *resp, uint16_t len, uint8_t sid)
+{
+  if (len >= 1 && resp[0] == UDS_POSITIVE(sid)) return UDS_RESP_POSITIVE;
+  if (len < 3 || resp[0] != UDS_SID_NEGATIVE || resp[1] != sid) return UDS_RESP_FOREIGN;
+
+  switch (resp[2]) {
+    case UDS_NRC_RESPONSE_PENDING:
+      return UDS_RESP_PENDING;
+    case UDS_NRC_SERVICE_NOT_SUPPORTED:
+    case UDS_NRC_SUBFUNC_NOT_SUPPORTED:
+    case UDS_NRC_INCORRECT_LENGTH:
+    case UDS_NRC_RESPONSE_TOO_LONG:
+    case UDS_NRC_OUT_OF_RANGE:
+    case UDS_NRC_SECURITY_DENIED:
+      return UDS_RESP_UNSUPPORTED;
+    case UDS_NRC_SUBFUNC_NOT_IN_SESSION:
+    case UDS_NRC_SERVICE_NOT_IN_SESSION:
+      return UDS_RESP_SESSION;
+    default:
+      return UDS_RESP_RETRY; // generalReject, busyRepeatRequest, conditionsNotCorrect, ...
+  }
+}
+
+const char *UDS_NRC_Name(uint8_t nrc)
+{
+  switch (nrc) {
+    case UDS_NRC_GENERAL_REJECT:          return "General reject";
+    case UDS_NRC_SERVICE_NOT_SUPPORTED:   return "Service not supported";
+    case UDS_NRC_SUBFUNC_NOT_SUPPORTED:   return "Sub-function not supported";
+    case UDS_NRC_INCORRECT_LENGTH:        return "Invalid format";
+    case UDS_NRC_RESPONSE_TOO_LONG:       return "Response too long";
+    case UDS_NRC_BUSY_REPEAT:             return "Busy, repeat request";
+    case UDS_NRC_CONDITIONS_NOT_CORRECT:  return "Conditions not correct";
+    case UDS_NRC_OUT_OF_RANGE:            return "Request out of range";
+    case UDS_NRC_SECURITY_DENIED:         return "Security access denied";
+    case UDS_NRC_RESPONSE_PENDING:        return "Response pending";
+    case UDS_NRC_SUBFUNC_NOT_IN_SESSION:  return "Sub-function not in session";
+    case UDS_NRC_SERVICE_NOT_IN_SESSION:  return "Service not in session";
+    default:                              return "Unknown error";
+  }
+}
+
+uint8_t UDS_Parse_RDBI(const uint8_t *resp, uint16_t len, const uint16_t *dids, const uint8_t *lens,
+                       uint8_t count, uint16_t *offsets, uint16_t *sizes)
+{
+  uint8_t got = 0;
+
+  for (uint8_t k = 0; k < count; k++) offsets[k] = 0;
+  if (len < 1 || resp[0] != UDS_POSITIVE(UDS_SID_RDBI)) return 0;
+
+  for (uint16_t i = 1; i + 2 <= len; ) {
+    uint16_t did = (resp[i] << 8) | resp[i + 1];
+    uint8_t k = 0;
+    while (k < count && (dids[k] != did || offsets[k])) k++;
+    if (k == count) break; // Чужой DID - длина неизвестна, дальше разобрать нельзя
+
+    uint16_t n = lens[k] ? lens[k] : len - i - 2;
+    if (i + 2 + n > len) break;
+    offsets[k] = i + 2;
+    sizes[k] = n;
+    got++;
+    i += 2 + n;
+  }
+  return got;
+}
+
+uint8_t UDS_Parse_DSC(const uint8_t *resp, uint16_t len, uint8_t session,
+                      uint16_t *p2_ms, uint32_t *p2_star_ms)
+{
+  if (len < 2 || resp[0] != UDS_POSITIVE(UDS_SID_DSC) || (resp[1] & 0x7F) != (session & 0x7F)) return 0;
+  if (len >= 6) {
+    *p2_ms = (resp[2] << 8) | resp[3];
+    *p2_star_ms = ((resp[4] << 8) | resp[5]) * (uint32_t)UDS_P2_STAR_UNIT_MS;
+  }
+  return 1;
+}
@@ -95,6 +95,12 @@ uint8_t UserRxBufferFS[APP_RX_DATA_SIZE];
 uint8_t UserTxBufferFS[APP_TX_DATA_SIZE];
 
 /* USER CODE BEGIN PRIVATE_VARIABLES */
+// Потоковая передача: кольцо байт, передача продолжается из прерывания USB
+static uint8_t stream_buf[CDC_STREAM_SIZE];
+static volatile uint16_t stream_head;    // Пишет основной цикл (счетчик без заворота)
+static volatile uint16_t stream_tail;    // Освобождает CDC_TransmitCplt_FS
+static volatile uint16_t stream_sending; // Длина текущей передачи, 0 - передачи нет
+static volatile uint32_t stream_drops;   // Записей, не поместившихся в кольцо
 
 /* USER CODE END PRIVATE_VARIABLES */
 
@@ -129,6 +135,7 @@ static int8_t CDC_Receive_FS(uint8_t* pbuf, uint32_t *Len);
 static int8_t CDC_TransmitCplt_FS(uint8_t *pbuf, uint32_t *Len, uint8_t epnum);
 
 /* USER CODE BEGIN PRIVATE_FUNCTIONS_DECLARATION */
+static void CDC_Stream_Kick(void);
 
 /* USER CODE END PRIVATE_FUNCTIONS_DECLARATION */
 
@@ -339,12 +346,82 @@ static int8_t CDC_TransmitCplt_FS(uint8_t *Buf, uint32_t *Len, uint8_t epnum)
   UNUSED(Len);
   UNUSED(epnum);
   usb_trans_ok = 1;
+  if (stream_sending) {
+    stream_tail += stream_sending;
+    stream_sending = 0;
+    CDC_Stream_Kick(); // Следующий кусок без участия основного цикла
+  }
   /* USER CODE END 13 */
   return result;
 }
 
 /* USER CODE BEGIN PRIVATE_FUNCTIONS_IMPLEMENTATION */
 
+/**
+  * @brief  Запуск передачи непрерывного куска кольца (до конца буфера).
+  *         Вызывается из прерывания USB или при запрещенном OTG_FS_IRQn.
+  */
+static void CDC_Stream_Kick(void)
+{
+  USBD_CDC_HandleTypeDef *hcdc = (USBD_CDC_HandleTypeDef*)hUsbDeviceFS.pClassData;
+  uint16_t used = stream_head - stream_tail;
+
+  if (stream_sending || used == 0 || hcdc == NULL || hcdc->TxState != 0){
+    return;
+  }
+  uint16_t offset = stream_tail & (CDC_STREAM_SIZE - 1);
+  uint16_t len = CDC_STREAM_SIZE - offset;
+  if (len > used)
+      { len = used;}
+
+  stream_sending = len;
+  USBD_CDC_SetTxBuffer(&hUsbDeviceFS, &stream_buf[offset], len);
+  if (USBD_CDC_TransmitPacket(&hUsbDeviceFS) != USBD_OK)
+      { stream_sending = 0;}
+}
+
+/**
+  * @brief  Запись в поток без ожидания: запись целиком или ничего.
+  * @retval len - записано, 0 - места нет (запись считается потерянной)
+  */
+uint16_t CDC_Stream_Write(const uint8_t* Buf, uint16_t Len)
+{
+  uint16_t head = stream_head;
+
+  if ((uint16_t)(CDC_STREAM_SIZE - (uint16_t)(head - stream_tail)) < Len){
+    stream_drops++;
+    return 0;
+  }
+  for (uint16_t i = 0; i < Len; i++){
+    stream_buf[(head + i) & (CDC_STREAM_SIZE - 1)] = Buf[i];
+  }
+  __DMB(); // Данные записаны до публикации head
+  stream_head = head + Len;
+  return Len;
+}
+
+/**
+  * @brief  Запуск передачи накопленных данных, если USB свободен.
+  *         Пока порт не открыт, данные отбрасываются (их некому читать).
+  */
+void CDC_Stream_Flush(void)
+{
+  HAL_NVIC_DisableIRQ(OTG_FS_IRQn);
+  if (!usb_com_open && !stream_sending){
+    stream_tail = stream_head;
+  }
+  CDC_Stream_Kick();
+  HAL_NVIC_EnableIRQ(OTG_FS_IRQn);
+}
+
+/**
+  * @brief  Количество записей, потерянных из-за переполнения потока.
+  */
+uint32_t CDC_Stream_Drops(void)
+{
+  return stream_drops;
+}
+
 /* USER CODE END PRIVATE_FUNCTIONS_IMPLEMENTATION */
 
 /**
@@ -0,0 +1,285 @@
+#!/usr/bin/env python3
+"""Компилятор DBC в таблицы C для декодера can_db (Inc/can_db.h).
+
+    python3 Tools/dbc2c.py Tools/example.dbc
+
+Пишет Inc/can_db_table.h (количество и индексы сигналов) и
+Src/can_db_table.c (сообщения по возрастанию ID и их сигналы).
+Для каждого сигнала заранее считаются сдвиг и маска в 64-битном слове
+кадра, масштаб переводится в целые num/den/offset с decimals знаками -
+на устройстве ни разбора битовых позиций, ни float.
+
+Мультиплексированные сигналы (m<N>), сигналы длиннее 32 бит и те, чье
+значение не помещается в int32 и при 0 знаков после запятой, пропускаются
+с предупреждением.
+
+Декодер собирается только с USE_CAN_DB в defineList сборки: таблицы в
+дереве - из образца Tools/example.dbc, для автомобиля их нужно
+сгенерировать из его DBC.
+
+Заодно пишет таблицу разбора 11-битных ID (Inc/can_dispatch_table.h,
+Src/can_dispatch_table.c): битовая карта на 2048 ID, число единиц до
+каждого слова и плотный массив слотов. В ней сообщения DBC и ответы ECU
+по ISO-TP (--isotp, по умолчанию 0x7E8-0x7EF из ISO 15765-4).
+"""
+
+import argparse
+import os
+import re
+import sys
+from fractions import Fraction
+
+MAX_DECIMALS = 3
+MAX_DEN = 1000
+INT32_MAX = 0x7FFFFFFF
+
+RE_MESSAGE = re.compile(r'^BO_\s+(\d+)\s+(\w+)\s*:\s*(\d+)')
+RE_SIGNAL = re.compile(
+    r'^\s+SG_\s+(\w+)\s*(M|m\d+)?\s*:\s*(\d+)\|(\d+)@([01])([+-])\s*'
+    r'\(\s*([^,\s]+)\s*,\s*([^)\s]+)\s*\)\s*\[[^\]]*\]\s*"([^"]*)"')
+
+# Единицы DBC -> OBD_Unit (Inc/obd_pid.h)
+UNITS = {
+    '': 'OBD_UNIT_NONE',
+    '%': 'OBD_UNIT_PERCENT',
+    'degc': 'OBD_UNIT_DEG_C', '°c': 'OBD_UNIT_DEG_C', 'c': 'OBD_UNIT_DEG_C',
+    'kpa': 'OBD_UNIT_KPA',
+    'pa': 'OBD_UNIT_PA',
+    'rpm': 'OBD_UNIT_RPM', '1/min': 'OBD_UNIT_RPM',
+    'km/h': 'OBD_UNIT_KMH', 'kph': 'OBD_UNIT_KMH',
+    'deg': 'OBD_UNIT_DEG', '°': 'OBD_UNIT_DEG',
+    'g/s': 'OBD_UNIT_GS',
+    'v': 'OBD_UNIT_V',
+    'ma': 'OBD_UNIT_MA',
+    's': 'OBD_UNIT_S',
+    'min': 'OBD_UNIT_MIN',
+    'km': 'OBD_UNIT_KM',
+    'l/h': 'OBD_UNIT_LH',
+    'nm': 'OBD_UNIT_NM',
+}
+
+
+def warn(msg):
+    print('dbc2c: ' + msg, file=sys.stderr)
+
+
+def decimals_of(text):
+    """Знаков после запятой в записи числа (1e-3 тоже)."""
+    f = Fraction(text)
+    for d in range(MAX_DECIMALS + 1):
+        if (f * 10 ** d).denominator == 1:
+            return d
+    return MAX_DECIMALS
+
+
+def ident(name):
+    """EngineSpeedJ1939 -> ENGINE_SPEED_J1939"""
+    s = re.sub(r'([a-z0-9])([A-Z])', r'\1_\2', name)
+    s = re.sub(r'([A-Z]+)([A-Z][a-z])', r'\1_\2', s)
+    return re.sub(r'\W+', '_', s).upper()
+
+
+class Signal:
+    def __init__(self, message, m):
+        self.message = message
+        self.name = m.group(1)
+        start, self.bits = int(m.group(3)), int(m.group(4))
+        self.motorola = m.group(5) == '0'
+        self.signed = m.group(6) == '-'
+        factor, offset = Fraction(m.group(7)), Fraction(m.group(8))
+        self.unit_text = m.group(9)
+
+        # Слово кадра: Intel - data[0] в младшем байте, Motorola - в старшем.
+        # Motorola: start - старший бит в нумерации DBC (байт * 8 + бит 7..0)
+        if self.motorola:
+            msb = (7 - start // 8) * 8 + start % 8
+            self.shift = msb - self.bits + 1
+            self.dlc = 8 - self.shift // 8
+        else:
+            self.shift = start
+            self.dlc = (start + self.bits + 7) // 8
+        if self.shift < 0 or self.shift + self.bits > 64:
+            raise ValueError('%s: биты за пределами 8 байт' % self.name)
+
+        # На устройстве raw * num / den + offset считается в int32 (без 64-битного
+        # деления): не помещается - меньше знаков после запятой
+        raw_max = (1 << (self.bits - 1)) if self.signed else (1 << self.bits) - 1
+        self.decimals = max(decimals_of(m.group(7)), decimals_of(m.group(8)))
+        while True:
+            scale = 10 ** self.decimals
+            ratio = (factor * scale).limit_denominator(MAX_DEN)
+            self.num, self.den = ratio.numerator, ratio.denominator
+            self.offset = round(offset * scale)
+            product = raw_max * abs(self.num)
+            if product <= INT32_MAX and product // self.den + abs(self.offset) <= INT32_MAX:
+                break
+            if self.decimals == 0:
+                raise ValueError('%s: значение не помещается в int32' % self.name)
+            self.decimals -= 1
+        if ratio != factor * scale:
+            warn('%s: масштаб %s округлен до %s/%d' % (self.name, m.group(7), ratio, scale))
+
+        self.unit = UNITS.get(self.unit_text.lower())
+        if self.unit is None:
+            warn('%s: единица "%s" не из OBD_Unit' % (self.name, self.unit_text))
+            self.unit = 'OBD_UNIT_NONE'
+
+
+def parse(path):
+    messages = []
+    current = None
+    with open(path, encoding='latin-1') as f:
+        for line in f:
+            m = RE_MESSAGE.match(line)
+            if m:
+                current = {'id': int(m.group(1)), 'name': m.group(2), 'signals': []}
+                if current['id'] == 0xC0000000:  # VECTOR__INDEPENDENT_SIG_MSG
+                    current = None
+                else:
+                    messages.append(current)
+                continue
+            m = RE_SIGNAL.match(line)
+            if not m or current is None:
+                continue
+            if m.group(2) and m.group(2).startswith('m'):
+                warn('%s.%s: мультиплексированный сигнал пропущен' % (current['name'], m.group(1)))
+                continue
+            if int(m.group(4)) > 32:
+                warn('%s.%s: длиннее 32 бит, пропущен' % (current['name'], m.group(1)))
+                continue
+            try:
+                current['signals'].append(Signal(current['name'], m))
+            except ValueError as err:
+                warn('%s.%s, пропущен' % (current['name'], err))
+    messages = [msg for msg in messages if msg['signals']]
+    messages.sort(key=lambda msg: msg['id'])
+    return messages
+
+
+def c_string(s):
+    return '"%s"' % s.replace('\\', '\\\\').replace('"', '\\"')
+
+
+def generate(messages, source, inc_path, src_path):
+    signals = [sig for msg in messages for sig in msg['signals']]
+    names = {}
+    for sig in signals:
+        names.setdefault(ident(sig.name), []).append(sig)
+    banner = '/* Сгенерировано Tools/dbc2c.py из %s - не править вручную */\n' % os.path.basename(source)
+
+    h = [banner,
+         '#ifndef __CAN_DB_TABLE_H\n#define __CAN_DB_TABLE_H\n\n',
+         '#define CAN_DB_MESSAGE_COUNT  %d\n' % len(messages),
+         '#define CAN_DB_SIGNAL_COUNT   %d\n\n' % len(signals),
+         '// Индексы в can_db_signals[] и can_db_values[]\n']
+    width = max(len(ident(s.name)) + len(ident(s.message)) + 1 for s in signals) + len('CAN_DB_')
+    for i, sig in enumerate(signals):
+        name = ident(sig.name)
+        if len(names[name]) > 1:
+            name = ident(sig.message) + '_' + name
+        h.append('#define %-*s %3d  // %s.%s\n' % (width, 'CAN_DB_' + name, i, sig.message, sig.name))
+    h.append('\n#endif /* __CAN_DB_TABLE_H */\n')
+
+    c = [banner, '#include "can_db.h"\n\n',
+         'const CAN_DB_Message can_db_messages[CAN_DB_MESSAGE_COUNT] = {\n']
+    first = 0
+    for msg in messages:
+        kind = '29 бит' if msg['id'] & 0x80000000 else '11 бит'
+        c.append('  { 0x%08X, %3d, %d },  // %s, %s\n' % (msg['id'], first, len(msg['signals']), msg['name'], kind))
+        first += len(msg['signals'])
+    c.append('};\n\n')
+    c.append('const CAN_DB_Signal can_db_signals[CAN_DB_SIGNAL_COUNT] = {\n')
+    c.append('  // shift, bits, flags, dlc, mask, unit, decimals, num, den, offset, name\n')
+    for sig in signals:
+        flags = ' | '.join(f for f, on in (('CAN_DB_MOTOROLA', sig.motorola), ('CAN_DB_SIGNED', sig.signed)) if on) or '0'
+        c.append('  { %2d, %2d, %s, %d, 0x%08X, %s, %d, %d, %d, %d, %s },\n' % (
+            sig.shift, sig.bits, flags, sig.dlc, (1 << sig.bits) - 1, sig.unit,
+            sig.decimals, sig.num, sig.den, sig.offset, c_string(sig.name)))
+    c.append('};\n')
+
+    with open(inc_path, 'w', encoding='utf-8', newline='\n') as f:
+        f.write(''.join(h))
+    with open(src_path, 'w', encoding='utf-8', newline='\n') as f:
+        f.write(''.join(c))
+
+
+def parse_range(text):
+    """0x7E8-0x7EF или 0x7E8 -> список ID"""
+    lo, _, hi = text.partition('-')
+    lo = int(lo, 0)
+    return list(range(lo, int(hi, 0) + 1 if hi else lo + 1))
+
+
+def generate_dispatch(messages, isotp, source, inc_path, src_path):
+    slots = {}
+    for i, msg in enumerate(messages):
+        if not msg['id'] & 0x80000000:
+            slots[msg['id']] = ('CAN_DISPATCH_DB', i, msg['name'])
+    for k, can_id in enumerate(isotp):
+        if not 0 <= can_id < 0x800:
+            sys.exit('dbc2c: ISO-TP ID 0x%X не 11-битный' % can_id)
+        if can_id in slots:
+            sys.exit('dbc2c: ID 0x%03X и в DBC (%s), и в ISO-TP' % (can_id, slots[can_id][2]))
+        slots[can_id] = ('CAN_DISPATCH_ISOTP', k, 'ответ ECU')
+
+    ids = sorted(slots)
+    bitmap = [0] * 64
+    for can_id in ids:
+        bitmap[can_id >> 5] |= 1 << (can_id & 31)
+    rank, ones = [], 0
+    for word in bitmap:
+        rank.append(ones)
+        ones += bin(word).count('1')
+    banner = '/* Сгенерировано Tools/dbc2c.py из %s - не править вручную */\n' % os.path.basename(source)
+
+    h = [banner,
+         '#ifndef __CAN_DISPATCH_TABLE_H\n#define __CAN_DISPATCH_TABLE_H\n\n',
+         '#define CAN_DISPATCH_STD_IDS    %d  // 11-битных ID в таблице\n' % len(ids),
+         '#define CAN_DISPATCH_ISOTP_IDS  %d  // Из них ответов ECU (ISO-TP)\n' % len(isotp),
+         '\n#endif /* __CAN_DISPATCH_TABLE_H */\n']
+
+    def rows(values, fmt):
+        return ''.join('  %s,\n' % ', '.join(fmt % v for v in values[i:i + 8]) for i in range(0, len(values), 8))
+
+    c = [banner, '#include "can_dispatch.h"\n\n',
+         '// Бит (id & 31) слова id >> 5 - ID в таблице\n',
+         'const uint32_t can_dispatch_bitmap[64] = {\n', rows(bitmap, '0x%08X'), '};\n\n',
+         '// Единиц карты в словах до данного\n',
+         'const uint16_t can_dispatch_rank[64] = {\n', rows(rank, '%4d'), '};\n\n',
+         '// Слоты по возрастанию ID, [0] - для ID вне таблицы\n',
+         'const uint16_t can_dispatch_slots[CAN_DISPATCH_STD_IDS + 1] = {\n',
+         '  CAN_DISPATCH_NONE,\n']
+    for can_id in ids:
+        handler, arg, name = slots[can_id]
+        c.append('  CAN_DISPATCH_SLOT(%s, %d),  // 0x%03X %s\n' % (handler, arg, can_id, name))
+    c.append('};\n')
+
+    with open(inc_path, 'w', encoding='utf-8', newline='\n') as f:
+        f.write(''.join(h))
+    with open(src_path, 'w', encoding='utf-8', newline='\n') as f:
+        f.write(''.join(c))
+
+
+def main():
+    root = os.path.dirname(os.path.dirname(os.path.abspath(__file__)))
+    ap = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    ap.add_argument('dbc')
+    ap.add_argument('--inc', default=os.path.join(root, 'Inc', 'can_db_table.h'))
+    ap.add_argument('--src', default=os.path.join(root, 'Src', 'can_db_table.c'))
+    ap.add_argument('--isotp', action='append', metavar='ID[-ID]',
+                    help='11-битные ответы ECU (по умолчанию 0x7E8-0x7EF)')
+    ap.add_argument('--dispatch-inc', default=os.path.join(root, 'Inc', 'can_dispatch_table.h'))
+    ap.add_argument('--dispatch-src', default=os.path.join(root, 'Src', 'can_dispatch_table.c'))
+    args = ap.parse_args()
+
+    messages = parse(args.dbc)
+    if not messages:
+        sys.exit('dbc2c: в %s нет сообщений с сигналами' % args.dbc)
+    generate(messages, args.dbc, args.inc, args.src)
+    isotp = sorted({can_id for r in (args.isotp or ['0x7E8-0x7EF']) for can_id in parse_range(r)})
+    generate_dispatch(messages, isotp, args.dbc, args.dispatch_inc, args.dispatch_src)
+    print('dbc2c: %d сообщений, %d сигналов' % (len(messages), sum(len(m['signals']) for m in messages)))
+
+
+if __name__ == '__main__':
+    main()